@@ -15,15 +15,24 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
-#include <fstream>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <sstream>
+#include <vector>
+
+#include <SDL2/SDL_timer.h>
 
 #include "Audio.h"
+#include "AudioManager.h"
 #include "Language.h"
 #include "Log.h"
 
+#ifdef DAGON_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace dagon {
 
 ////////////////////////////////////////////////////////////
@@ -38,14 +47,57 @@ log(Log::instance())
   _isLoaded = false;
   _isLoopable = false;
   _isMatched = false;
+  _isMixed = false;
+  _isSample = false;
+  _hasStreamingError = false;
+  _hasPosition = false;
+  _pendingCommands = 0;
+  _priority = kAudioPrioritySound;
   _state = kAudioInitial;
+  _voice = NULL;
+  _virtualCursor = 0.0;
+  _virtualTime = 0;
+  _length = 0.0;
+  _sample = 0;
+  _ring = NULL;
+  _ringOffset = 0;
+  _isDecoding = false;
+  _hasPendingSeek = false;
+  _seekTime = 0.0;
+  _decodeCursor = 0.0;
+  _ringGeneration = 0;
+  _mixGain = 0.0f;
+  _hasStarted = false;
+  _isSyncing = false;
+  _syncTime = 0.0;
+  _queuedHead = 0;
+  _numOfQueued = 0;
+  _streamCursor = 0.0;
+  _cursorLock = 0;
+  _publishedCursor = 0.0;
+  _publishedLength = 0.0;
+  _publishedTime = 0;
+  _isPublishedAudible = false;
+  _isPublishedLoopable = false;
+  _stats.underruns = 0;
+  _stats.blocks = 0;
+  _stats.decodeTime = 0.0;
+  _stats.refills = 0;
+  _stats.refillLatency = 0.0;
+  _stats.queueDepth = 0;
+  _stats.minQueueDepth = kMaxAudioBuffers;
+  _stats.streams = 0;
+  _statsLock = 0;
+  _resource.data = NULL;
+  _resource.file = NULL;
   _oggCallbacks.read_func = _oggRead;
   _oggCallbacks.seek_func = _oggSeek;
   _oggCallbacks.close_func = _oggClose;
   _oggCallbacks.tell_func = _oggTell;
   this->setType(kObjectAudio);
   _mutex = SDL_CreateMutex();
-  if (!_mutex)
+  _streamMutex = SDL_CreateMutex();
+  if (!_mutex || !_streamMutex)
     log.error(kModAudio, "%s", kString18001);
 }
 
@@ -55,6 +107,7 @@ log(Log::instance())
 
 Audio::~Audio() {
   // TODO: Unload if required
+  SDL_DestroyMutex(_streamMutex);
   SDL_DestroyMutex(_mutex);
 }
 
@@ -65,6 +118,17 @@ Audio::~Audio() {
 bool Audio::doesAutoplay() {
   return _doesAutoplay;
 }
+
+bool Audio::hasVoice() {
+  bool value = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    value = (_voice != NULL);
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return value;
+}
   
 bool Audio::isLoaded() {
   bool value = false;
@@ -97,7 +161,36 @@ bool Audio::isPlaying() {
 ////////////////////////////////////////////////////////////
 
 double Audio::cursor() {
-  return ov_time_tell(&_oggStream);
+  SDL_AtomicLock(&_cursorLock);
+  double value = _publishedCursor;
+  Uint64 time = _publishedTime;
+  double length = _publishedLength;
+  bool isAudible = _isPublishedAudible;
+  bool isLoopable = _isPublishedLoopable;
+  SDL_AtomicUnlock(&_cursorLock);
+  
+  // Carry on from the last snapshot while the source keeps playing
+  if (isAudible)
+    value += static_cast<double>(SDL_GetPerformanceCounter() - time) /
+             SDL_GetPerformanceFrequency();
+  if (length > 0.0) {
+    if (isLoopable)
+      value = std::fmod(value, length);
+    else if (value > length)
+      value = length;
+  }
+  return value;
+}
+
+double Audio::length() {
+  SDL_AtomicLock(&_cursorLock);
+  double value = _publishedLength;
+  SDL_AtomicUnlock(&_cursorLock);
+  return value;
+}
+
+int Audio::priority() {
+  return _priority;
 }
 
 int Audio::state() {
@@ -117,47 +210,27 @@ void Audio::setLoopable(bool loopable) {
 }
 
 void Audio::setPosition(unsigned int face, Point origin) {
-  if (SDL_LockMutex(_mutex) == 0) {  
+  AudioCommand command;
+  bool hasCommand = false;
+  if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded) {
-      float x = origin.x / kDefTexSize;
-      float y = origin.y / kDefTexSize;
-  
-      switch (face) {
-        case kNorth: {
-          alSource3f(_alSource, AL_POSITION, x, y, -1.0f);
-          break;
-        }
-        case kEast: {
-          alSource3f(_alSource, AL_POSITION, 1.0f, y, x);
-          break;
-        }
-        case kSouth: {
-          alSource3f(_alSource, AL_POSITION, -x, y, 1.0f);
-          break;
-        }
-        case kWest: {
-          alSource3f(_alSource, AL_POSITION, -1.0f, y, -x);
-          break;
-        }
-        case kUp: {
-          alSource3f(_alSource, AL_POSITION, 0.0f, 1.0f, 0.0f);
-          break;
-        }
-        case kDown: {
-          alSource3f(_alSource, AL_POSITION, 0.0f, -1.0f, 0.0f);
-          break;
-        }
-        default: {
-          assert(false);
-        }
-      }
-  
-      _verifyError("position");
-	}
+      command.type = kAudioCommandPosition;
+      command.face = face;
+      command.origin = origin;
+      _pendingCommands++;
+      hasCommand = true;
+    }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  if (hasCommand)
+    _post(command);
+}
+
+void Audio::setPriority(int priority) {
+  _priority = priority;
 }
 
 void Audio::setResource(std::string fileName) {
@@ -168,27 +241,174 @@ void Audio::setResource(std::string fileName) {
 // Implementation - State changes
 ////////////////////////////////////////////////////////////
 
+void Audio::execute(const AudioCommand &command) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _pendingCommands--;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  switch (command.type) {
+    case kAudioCommandPlay: {
+      _play();
+      break;
+    }
+    case kAudioCommandPause: {
+      _pause();
+      break;
+    }
+    case kAudioCommandStop: {
+      _stop();
+      break;
+    }
+    case kAudioCommandPosition: {
+      _setPosition(command.face, command.origin);
+      break;
+    }
+    default: {
+      assert(false);
+    }
+  }
+}
+
+bool Audio::attachVoice(AudioVoice* voice) {
+  bool value = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded && !_voice && !_isMixed) {
+      _voice = voice;
+      _alSource = voice->source;
+      
+      alSource3f(_alSource, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+      alSource3f(_alSource, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+      if (_hasPosition)
+        _setPosition(_face, _origin);
+      else
+        alSource3f(_alSource, AL_POSITION, 0.0f, 0.0f, 0.0f);
+      
+      if (config.mute || this->fadeLevel() < 0.0) {
+        alSourcef(_alSource, AL_GAIN, 0.0f);
+      } else {
+        alSourcef(_alSource, AL_GAIN, this->fadeLevel());
+      }
+      
+      // Resume from wherever the audio was while it had no voice, or in step
+      // with the audio it follows
+      if (_isSample) {
+        alSourcei(_alSource, AL_LOOPING, _isLoopable);
+        alSourcei(_alSource, AL_BUFFER, _sample);
+      } else {
+        alSourcei(_alSource, AL_LOOPING, AL_FALSE);
+      }
+      if (_isMatched && (_state == kAudioPlaying)) {
+        _resync(_matchedAudio->cursor());
+      } else if (_isSample) {
+        alSourcef(_alSource, AL_SEC_OFFSET, (ALfloat)_virtualCursor);
+        if (_state == kAudioPlaying)
+          alSourcePlay(_alSource);
+      } else {
+        // Blocks decoded ahead are kept when they start where we resume, as
+        // on a first play. The source starts once the decoders have caught up.
+        _resetVoice();
+        if (_isStreamAt(_virtualCursor))
+          _streamCursor = _virtualCursor;
+        else
+          _rewindStream(_virtualCursor);
+      }
+      _verifyError("voice");
+      
+      value = true;
+    }
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return value;
+}
+
+AudioVoice* Audio::detachVoice() {
+  AudioVoice* voice = NULL;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_voice) {
+      _virtualCursor = _cursor();
+      _virtualTime = SDL_GetTicks();
+      _hasStarted = false;
+      _isSyncing = false;
+      
+      alSourceStop(_alSource);
+      alSourcei(_alSource, AL_BUFFER, 0);
+      _verifyError("voice");
+      
+      voice = _voice;
+      _voice = NULL;
+      
+      SDL_AtomicLock(&_statsLock);
+      _stats.streams = 0;
+      SDL_AtomicUnlock(&_statsLock);
+    }
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return voice;
+}
+
 void Audio::load() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (!_isLoaded) {
+      AudioManager& audioManager = AudioManager::instance();
       std::string fileToLoad = _randomizeFile(_resource.name);
-      std::ifstream file(config.path(kPathResources,
-                                     fileToLoad, kObjectAudio).c_str(),
-                         std::ifstream::binary | std::ifstream::ate);
-      if (file.good()) {
-        _resource.dataSize = file.tellg();
-        _resource.data = new char[_resource.dataSize];
-        file.seekg(file.beg);
-        file.read(_resource.data, _resource.dataSize);
+      _virtualCursor = 0.0;
+      _virtualTime = SDL_GetTicks();
+      
+      // Short clips decoded before are shared, so we skip the file entirely
+      _sample = audioManager.retainSample(fileToLoad);
+      if (_sample) {
+        ALint bits, channels, frequency, size;
+        alGetBufferi(_sample, AL_BITS, &bits);
+        alGetBufferi(_sample, AL_CHANNELS, &channels);
+        alGetBufferi(_sample, AL_FREQUENCY, &frequency);
+        alGetBufferi(_sample, AL_SIZE, &size);
+        if (bits && channels && frequency)
+          _length = static_cast<double>(size) / (frequency * channels * (bits / 8));
+        _rate = frequency;
+        _isSample = true;
+        _sampleFile = fileToLoad;
+        _isLoaded = true;
+        _verifyError("load");
+        SDL_UnlockMutex(_mutex);
+        return;
+      }
+      
+      std::FILE* file = std::fopen(config.path(kPathResources,
+                                               fileToLoad, kObjectAudio).c_str(), "rb");
+      if (file) {
+        std::fseek(file, 0, SEEK_END);
+        _resource.dataSize = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
         _resource.dataRead = 0;
         
+        if (_resource.dataSize > kAudioStreamSize) {
+          // Long files keep their handle open and are read in chunks as
+          // the stream is decoded
+          std::setvbuf(file, NULL, _IOFBF, kAudioReadSize);
+          _resource.data = NULL;
+          _resource.file = file;
+        } else {
+          _resource.data = new char[_resource.dataSize];
+          _resource.dataSize = std::fread(_resource.data, 1, _resource.dataSize, file);
+          _resource.file = NULL;
+          
+          // We no longer require the file handle
+          std::fclose(file);
+        }
+        
         if (ov_open_callbacks(this, &_oggStream, NULL, 0, _oggCallbacks) < 0) {
           log.error(kModAudio, "%s", kString16010);
         }
         
-        // We no longer require the file handle
-        file.close();
-        
         // Get file info
         vorbis_info* info = ov_info(&_oggStream, -1);
         _channels = info->channels;
@@ -204,24 +424,52 @@ void Audio::load() {
           log.error(kModAudio, "%s: %s", kString16009, fileToLoad.c_str());
         }
         
-        alGenBuffers(config.numOfAudioBuffers, _alBuffers);
-        alGenSources(1, &_alSource);
-        alSource3f(_alSource, AL_POSITION, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-        alSource3f(_alSource, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-        
-		int buffersRead = 0;
-        for (buffersRead = 0; buffersRead < config.numOfAudioBuffers; buffersRead++) {
-          if (_fillBuffer(&_alBuffers[buffersRead]) == kAudioStreamEOF) {
-            break;
-          }
+        // Decode the whole clip at once if it's short enough
+        _length = ov_time_total(&_oggStream, -1);
+        if (ov_seekable(&_oggStream) && (_length >= 0.0) &&
+            ((_length * 1000.0) < config.audioSampleLength)) {
+          _sample = _decodeSample();
         }
-        alSourceQueueBuffers(_alSource, buffersRead, _alBuffers);
-        _verifyError("prebuffer");
-        if (config.mute || this->fadeLevel() < 0.0) {
-          alSourcef(_alSource, AL_GAIN, 0.0f);
+        
+        // Sources are lent by the manager once the audio plays
+        if (_sample) {
+          _sample = audioManager.registerSample(fileToLoad, _sample);
+          ov_clear(&_oggStream);
+          delete[] _resource.data;
+          _resource.data = NULL;
+          _isSample = true;
+          _sampleFile = fileToLoad;
         } else {
-          alSourcef(_alSource, AL_GAIN, this->fadeLevel());
+          // Prevent audio cuts if file size too small
+          _bufferSize = config.audioBuffer;
+          if (static_cast<int>(_resource.dataSize) < _bufferSize)
+            _bufferSize = static_cast<int>(_resource.dataSize);
+          
+          // One decode slot per buffer, so that refills never allocate
+          _numOfBuffers = std::max(kMinAudioBuffers,
+                                   std::min(config.numOfAudioBuffers, kMaxAudioBuffers));
+          char* ring = new char[_bufferSize * _numOfBuffers];
+          if (SDL_LockMutex(_streamMutex) == 0) {
+            _ringIndex = 0;
+            _ringRead = 0;
+            _ringFilled = 0;
+            _ringOffset = 0;
+            _hasStreamingError = false;
+            _isStreamEnded = false;
+            _isQueueEnded = false;
+            _hasPendingSeek = false;
+            _decodeCursor = 0.0;
+            
+            // Set last, as a non-null ring is what lets a decoder in
+            _ring = ring;
+            SDL_UnlockMutex(_streamMutex);
+          } else {
+            log.error(kModAudio, "%s", kString18002);
+            delete[] ring;
+          }
+          
+          // Start decoding right away so the audio is ready when played
+          audioManager.requestDecode(this);
         }
         
         _isLoaded = true;
@@ -230,6 +478,7 @@ void Audio::load() {
         log.error(kModAudio, "%s: %s", kString16008, fileToLoad.c_str());
       }
     }
+    _publishCursor();
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
@@ -242,60 +491,92 @@ void Audio::match(Audio* audioToMatch) {
 }
 
 void Audio::play() {
+  AudioCommand command;
+  bool hasCommand = false;
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded && (_state != kAudioPlaying)) {
-      if (_isMatched)
-        ov_time_seek(&_oggStream, _matchedAudio->cursor());
-      alSourcePlay(_alSource);
       _state = kAudioPlaying;
-      _verifyError("play");
+      command.type = kAudioCommandPlay;
+      _pendingCommands++;
+      hasCommand = true;
     }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  if (hasCommand)
+    _post(command);
 }
 
 void Audio::pause() {
+  AudioCommand command;
+  bool hasCommand = false;
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == kAudioPlaying) {
-      alSourceStop(_alSource);
       _state = kAudioPaused;
-      _verifyError("pause");
+      command.type = kAudioCommandPause;
+      _pendingCommands++;
+      hasCommand = true;
     }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  if (hasCommand)
+    _post(command);
 }
 
 void Audio::stop() {
+  AudioCommand command;
+  bool hasCommand = false;
   if (SDL_LockMutex(_mutex) == 0) {
     if ((_state == kAudioPlaying) || (_state == kAudioPaused)) {
-      alSourceStop(_alSource);
-      ov_raw_seek(&_oggStream, 0);
       _state = kAudioStopped;
-      _verifyError("stop");
+      command.type = kAudioCommandStop;
+      _pendingCommands++;
+      hasCommand = true;
     }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  
+  if (hasCommand)
+    _post(command);
 }
 
 void Audio::unload() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_isLoaded) {
-      if (_state == kAudioPlaying) {
-        alSourceStop(_alSource);
-        ov_raw_seek(&_oggStream, 0);
+      AudioManager& audioManager = AudioManager::instance();
+      AudioVoice* voice = this->detachVoice();
+      if (voice)
+        audioManager.releaseVoice(voice);
+      
+      if (_state == kAudioPlaying)
         _state = kAudioStopped;
+      _isMixed = false;
+      
+      if (_isSample) {
+        // The buffer belongs to the sample cache, so we only let go of it
+        audioManager.releaseSample(_sampleFile);
+        _isSample = false;
+        _sample = 0;
+      } else {
+        audioManager.cancelDecode(this);
+        if (SDL_LockMutex(_streamMutex) == 0) {
+          ov_clear(&_oggStream);
+          delete[] _resource.data;
+          _resource.data = NULL;
+          delete[] _ring;
+          _ring = NULL;
+          SDL_UnlockMutex(_streamMutex);
+        } else {
+          log.error(kModAudio, "%s", kString18002);
+        }
       }
-      _emptyBuffers();
-      alDeleteSources(1, &_alSource);
-      alDeleteBuffers(config.numOfAudioBuffers, _alBuffers);
-      ov_clear(&_oggStream);
-      delete[] _resource.data;
       _isLoaded = false;
       _verifyError("unload");
     }
@@ -305,17 +586,60 @@ void Audio::unload() {
   }
 }
 
-void Audio::update() {
+int Audio::update() {
+  int timeout = kAudioIdleTimeout;
   if (SDL_LockMutex(_mutex) == 0) {
-    if (_state == kAudioPlaying) {
-      int processed;
-      alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
-      while (processed--) {
-        ALuint buffer;
+    // Wait until the audio thread has caught up with any state change
+    if ((_state == kAudioPlaying) && !_pendingCommands) {
+      if (_isMixed) {
+        // Decoded blocks are pulled into the ambient bus by the manager
+      } else if (!_voice) {
+        // Virtual audios keep time so that they resume in the right place
+        Uint32 time = SDL_GetTicks();
+        _virtualCursor += (time - _virtualTime) / 1000.0;
+        _virtualTime = time;
+        if (_virtualCursor >= _length) {
+          if (_isLoopable && (_length > 0.0)) {
+            _virtualCursor = std::fmod(_virtualCursor, _length);
+          } else {
+            _virtualCursor = 0.0;
+            _state = kAudioStopped;
+          }
+        }
+      } else if (_isSample) {
+        // Nothing to stream, we just have to notice when the clip is done
+        ALint alState;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        if (alState == AL_STOPPED)
+          _state = kAudioStopped;
+      } else {
+        _queueBuffers();
         
-        alSourceUnqueueBuffers(_alSource, 1, &buffer);
-        _fillBuffer(&buffer);
-        alSourceQueueBuffers(_alSource, 1, &buffer);
+        ALint alState, queued;
+        alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+        alGetSourcei(_alSource, AL_BUFFERS_QUEUED, &queued);
+        if (alState != AL_PLAYING) {
+          // Either the first blocks just arrived or the source ran dry
+          if (_hasStarted && (alState == AL_STOPPED) && !_isQueueEnded) {
+            SDL_AtomicLock(&_statsLock);
+            _stats.underruns++;
+            SDL_AtomicUnlock(&_statsLock);
+            _hasStarted = false;
+          }
+          
+          if ((queued > 0) && !_isSyncing) {
+            alSourcePlay(_alSource);
+            _hasStarted = true;
+          } else if (_isQueueEnded) {
+            _state = kAudioStopped;
+          }
+        }
+        
+        SDL_AtomicLock(&_statsLock);
+        _stats.queueDepth = queued;
+        if (_hasStarted && !_isQueueEnded && (queued < _stats.minQueueDepth))
+          _stats.minQueueDepth = queued;
+        SDL_AtomicUnlock(&_statsLock);
       }
       
       // Run fade operations
@@ -323,90 +647,697 @@ void Audio::update() {
       
       // FIXME: Not very elegant as we're doing this check every time
       if (config.mute) {
-        alSourcef(_alSource, AL_GAIN, 0.0f);
+        if (_voice)
+          alSourcef(_alSource, AL_GAIN, 0.0f);
       } else {
         // Finally check the current volume. If it's zero, let the manager know
         // that we're done with this audio.
         if (this->fadeLevel() > 0.0) {
-          alSourcef(_alSource, AL_GAIN, this->fadeLevel());
+          if (_voice)
+            alSourcef(_alSource, AL_GAIN, this->fadeLevel());
         } else {
-          alSourceStop(_alSource);
+          if (_voice)
+            alSourcePause(_alSource);
           _state = kAudioPaused;
         }
       }
+      
+      if (this->isFading()) {
+        // Fades advance one step per update
+        timeout = 1;
+      } else if (_voice && !_isSample && (_state == kAudioPlaying)) {
+        // Come back as soon as one buffer has been played
+        int bytesPerSecond = _rate * _channels * 2;
+        if (bytesPerSecond > 0) {
+          timeout = (_bufferSize * 1000) / bytesPerSecond;
+          if (timeout < 1)
+            timeout = 1;
+          else if (timeout > kAudioIdleTimeout)
+            timeout = kAudioIdleTimeout;
+        }
+      }
     }
+    SDL_AtomicLock(&_statsLock);
+    _stats.streams = (_voice && !_isSample && (_state == kAudioPlaying)) ? 1 : 0;
+    SDL_AtomicUnlock(&_statsLock);
+    _publishCursor();
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModAudio, "%s", kString18002);
   }
+  return timeout;
 }
 
-////////////////////////////////////////////////////////////
-// Implementation - Private methods
-////////////////////////////////////////////////////////////
-
-int Audio::_fillBuffer(ALuint* buffer) {
-  // This is a failsafe; if this is true, we won't attempt to stream anymore
-  static bool _hasStreamingError = false;
-  
-  if (!_hasStreamingError) {
-    // Prevent audio cuts if file size too small
-    int bufferSize = config.audioBuffer;
-    if (static_cast<int>(_resource.dataSize) < bufferSize) {
-      //log.trace(kModAudio, "Buffer size: %d, file size: %d", bufferSize, _resource.dataSize);
-      bufferSize = static_cast<int>(_resource.dataSize);
+void Audio::decode() {
+  if (SDL_LockMutex(_streamMutex) == 0) {
+    // Another decoder thread is already filling the ring, and will go on
+    // until every free slot is taken
+    if (_isDecoding) {
+      SDL_UnlockMutex(_streamMutex);
+      return;
     }
+    _isDecoding = true;
     
-    char* data;
-    data = new char[bufferSize];
-    int size = 0;
-    while (size < bufferSize) {
-      int section;
-      long result = ov_read(&_oggStream, data + size, bufferSize - size,
-                            0, 2, 1, &section);
-      if (result > 0) {
-        size += static_cast<int>(result);
-      } else if (result == 0) {
-        // EOF
-        if (_isLoopable) {
+    // Fill every free slot, unless the stream is done or unloaded
+    while (_ring && !_hasStreamingError && !_isStreamEnded &&
+           (_ringFilled < _numOfBuffers)) {
+      int index = _ringIndex;
+      int generation = _ringGeneration;
+      bool hasSeek = _hasPendingSeek;
+      double seekTime = _seekTime;
+      _hasPendingSeek = false;
+      SDL_UnlockMutex(_streamMutex);
+      
+      // The audio thread only waits on the stream mutex to take or publish
+      // blocks, never for a read
+      Uint64 start = SDL_GetPerformanceCounter();
+      if (hasSeek) {
+        if (seekTime > 0.0)
+          ov_time_seek(&_oggStream, seekTime);
+        else
           ov_raw_seek(&_oggStream, 0);
+      }
+      
+      char* data = _ring + (index * _bufferSize);
+      double time = ov_time_tell(&_oggStream);
+      bool hasRewound = false;
+      bool isEnded = false;
+      bool hasError = false;
+      int size = 0;
+      while (size < _bufferSize) {
+        int section;
+        long result = ov_read(&_oggStream, data + size, _bufferSize - size,
+                              0, 2, 1, &section);
+        if (result > 0) {
+          size += static_cast<int>(result);
+          hasRewound = false;
+        } else if (result == 0) {
+          // EOF; loops carry on from the start within the same block
+          if (_isLoopable && !hasRewound) {
+            ov_raw_seek(&_oggStream, 0);
+            hasRewound = true;
+          } else {
+            isEnded = true;
+            break;
+          }
+        } else if (result == OV_HOLE) {
+          // May return OV_HOLE after we rewind the stream, so we just re-loop.
+          continue;
         } else {
-          alSourceStop(_alSource);
-          ov_raw_seek(&_oggStream, 0);
-          _state = kAudioStopped;
+          // Error
+          log.error(kModAudio, "%s: %s", kString16007, _resource.name.c_str());
+          hasError = true;
+          break;
         }
-        return kAudioStreamEOF;
-      } else if (result == OV_HOLE) {
-        // May return OV_HOLE after we rewind the stream, so we just re-loop.
-        continue;
-      } else if (result < 0) {
-        // Error
-        log.error(kModAudio, "%s: %s", kString16007, _resource.name.c_str());
+      }
+      double nextTime = ov_time_tell(&_oggStream);
+      double decodeTime = (SDL_GetPerformanceCounter() - start) * 1000.0 /
+                          SDL_GetPerformanceFrequency();
+      
+      if (SDL_LockMutex(_streamMutex) != 0) {
+        log.error(kModAudio, "%s", kString18002);
+        return;
+      }
+      if (hasError)
         _hasStreamingError = true;
-        return kAudioStreamError;
+      if (generation == _ringGeneration) {
+        _ringTimes[index] = time;
+        _ringSizes[index] = size;
+        _ringEnds[index] = isEnded || hasError;
+        _ringIndex = (index + 1) % _numOfBuffers;
+        _ringFilled++;
+        _isStreamEnded = isEnded;
+        _decodeCursor = nextTime;
       }
+      
+      SDL_AtomicLock(&_statsLock);
+      _stats.blocks++;
+      _stats.decodeTime += decodeTime;
+      SDL_AtomicUnlock(&_statsLock);
     }
-    alBufferData(*buffer, _alFormat, data, size, _rate);
-    delete[] data;
-    return kAudioStreamOK;
+    _isDecoding = false;
+    SDL_UnlockMutex(_streamMutex);
   } else {
-    return kAudioGenericError;
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::collectStats(AudioStats* stats) {
+  // Only the counters' own lock is taken, so polling them every frame never
+  // waits on a decode or a refill
+  SDL_AtomicLock(&_statsLock);
+  stats->underruns += _stats.underruns;
+  if (_stats.streams) {
+    if (_stats.queueDepth < stats->queueDepth)
+      stats->queueDepth = _stats.queueDepth;
+    if (_stats.minQueueDepth < stats->minQueueDepth)
+      stats->minQueueDepth = _stats.minQueueDepth;
+    stats->streams++;
   }
+  stats->blocks += _stats.blocks;
+  stats->decodeTime += _stats.decodeTime;
+  stats->refills += _stats.refills;
+  stats->refillLatency += _stats.refillLatency;
+  SDL_AtomicUnlock(&_statsLock);
 }
 
-void Audio::_emptyBuffers() {
+bool Audio::isAudible() {
+  SDL_AtomicLock(&_cursorLock);
+  bool value = _isPublishedAudible;
+  SDL_AtomicUnlock(&_cursorLock);
+  return value;
+}
+
+int Audio::sync() {
+  int timeout = kAudioIdleTimeout;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isMatched && _voice && (_state == kAudioPlaying) && !_pendingCommands) {
+      if (_isSyncing && (!_matchedAudio->hasVoice() || !_matchedAudio->isPlaying())) {
+        // Nothing audible to follow, so we simply start from here
+        _isSyncing = false;
+      } else if (_isSyncing) {
+        timeout = 1;
+        if (_matchedAudio->isAudible() && (_numOfQueued > 0)) {
+          // Start once the other audio reaches our first block, skipping
+          // whatever it played in the meantime
+          double late = _distance(_syncTime, _matchedAudio->cursor());
+          if (late >= 0.0) {
+            double queuedLength = 0.0;
+            for (int i = 0; i < _numOfQueued; i++)
+              queuedLength += _queuedLengths[(_queuedHead + i) % kMaxAudioBuffers];
+            if (late < queuedLength) {
+              alSourcei(_alSource, AL_SAMPLE_OFFSET, static_cast<ALint>(late * _rate));
+              alSourcePlay(_alSource);
+              _isSyncing = false;
+              _hasStarted = true;
+              _verifyError("sync");
+            } else {
+              _resync(_matchedAudio->cursor());
+            }
+          } else if (-late * 1000.0 > 1.0) {
+            timeout = static_cast<int>(-late * 1000.0);
+          }
+        }
+      } else if (_matchedAudio->isAudible() && _isAudible()) {
+        // Sources share the mixer clock, so this only triggers after an
+        // underrun on either side
+        double drift = _distance(_cursor(), _matchedAudio->cursor());
+        if (std::fabs(drift) > kAudioSyncTolerance)
+          _resync(_matchedAudio->cursor());
+      }
+    }
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return timeout;
+}
+
+bool Audio::isMixed() {
+  bool value = false;
+  if (SDL_LockMutex(_mutex) == 0) {
+    value = _isMixed;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return value;
+}
+
+void Audio::setMixed(bool mixed) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (!mixed) {
+      _isMixed = false;
+    } else if (_isLoaded && !_isSample && !_voice && !_isMatched && !_hasPosition &&
+               _isLoopable && (_rate == kAudioBusRate) &&
+               ((_channels == 1) || (_channels == 2))) {
+      // Only plain loops in the bus format qualify, everything else keeps
+      // a source of its own
+      _isMixed = true;
+      _mixGain = 0.0f;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::mix(float* buffer, int frames) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isMixed && (_state == kAudioPlaying) && !_pendingCommands) {
+      float gain = config.mute ? 0.0f : this->fadeLevel();
+      if (gain < 0.0f)
+        gain = 0.0f;
+      
+      // Ramp from the last gain so that fades don't step once per block
+      float step = (gain - _mixGain) / frames;
+      bool hasConsumed = false;
+      int mixed = 0;
+      if (SDL_LockMutex(_streamMutex) == 0) {
+        int frameSize = _channels * 2;
+        while ((mixed < frames) && (_ringFilled > 0)) {
+          int size = _ringSizes[_ringRead];
+          int count = (size - _ringOffset) / frameSize;
+          if (count > (frames - mixed))
+            count = frames - mixed;
+          
+          const short* samples = reinterpret_cast<const short*>(_ring +
+                                 (_ringRead * _bufferSize) + _ringOffset);
+          _accumulate(buffer + (mixed * 2), samples, count, _channels,
+                      _mixGain + (step * mixed), step);
+          mixed += count;
+          _ringOffset += count * frameSize;
+          
+          if ((_ringOffset + frameSize) > size) {
+            if (_ringEnds[_ringRead])
+              _isQueueEnded = true;
+            _ringRead = (_ringRead + 1) % _numOfBuffers;
+            _ringFilled--;
+            _ringOffset = 0;
+            hasConsumed = true;
+          }
+        }
+        
+        if (_ringFilled > 0)
+          _virtualCursor = _ringTimes[_ringRead] +
+                           (static_cast<double>(_ringOffset) / (_rate * frameSize));
+        if ((mixed < frames) && _hasStarted && !_isQueueEnded) {
+          SDL_AtomicLock(&_statsLock);
+          _stats.underruns++;
+          SDL_AtomicUnlock(&_statsLock);
+        }
+        if (mixed > 0)
+          _hasStarted = true;
+        if (_isQueueEnded && !_ringFilled)
+          _state = kAudioStopped;
+        SDL_UnlockMutex(_streamMutex);
+      } else {
+        log.error(kModAudio, "%s", kString18002);
+      }
+      _mixGain = gain;
+      
+      if (hasConsumed)
+        AudioManager::instance().requestDecode(this);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+void Audio::_play() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded) {
+      if (!_voice) {
+        // The manager starts the audio as soon as it gets a voice
+        if (_isMatched)
+          _virtualCursor = _matchedAudio->cursor();
+        _virtualTime = SDL_GetTicks();
+      } else if (_isMatched) {
+        if (_isSample)
+          alSourcei(_alSource, AL_LOOPING, _isLoopable);
+        _resync(_matchedAudio->cursor());
+        _verifyError("play");
+      } else {
+        if (_isSample)
+          alSourcei(_alSource, AL_LOOPING, _isLoopable);
+        alSourcePlay(_alSource);
+        _verifyError("play");
+      }
+    }
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::_pause() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_voice) {
+      alSourcePause(_alSource);
+      _verifyError("pause");
+    }
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::_stop() {
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_voice) {
+      alSourceStop(_alSource);
+      if (!_isSample)
+        _restartStream(0.0);
+      _verifyError("stop");
+    } else if (_isMixed) {
+      _rewindStream(0.0);
+    }
+    _isSyncing = false;
+    _virtualCursor = 0.0;
+    _publishCursor();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+void Audio::_setPosition(unsigned int face, Point origin) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Kept so that the position can be restored when a voice is attached
+    _hasPosition = true;
+    _face = face;
+    _origin = origin;
+    
+    if (_voice) {
+      float x = origin.x / kDefTexSize;
+      float y = origin.y / kDefTexSize;
+  
+      switch (face) {
+        case kNorth: {
+          alSource3f(_alSource, AL_POSITION, x, y, -1.0f);
+          break;
+        }
+        case kEast: {
+          alSource3f(_alSource, AL_POSITION, 1.0f, y, x);
+          break;
+        }
+        case kSouth: {
+          alSource3f(_alSource, AL_POSITION, -x, y, 1.0f);
+          break;
+        }
+        case kWest: {
+          alSource3f(_alSource, AL_POSITION, -1.0f, y, -x);
+          break;
+        }
+        case kUp: {
+          alSource3f(_alSource, AL_POSITION, 0.0f, 1.0f, 0.0f);
+          break;
+        }
+        case kDown: {
+          alSource3f(_alSource, AL_POSITION, 0.0f, -1.0f, 0.0f);
+          break;
+        }
+        default: {
+          assert(false);
+        }
+      }
+  
+      _verifyError("position");
+	}
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
+double Audio::_cursor() {
+  if (!_voice)
+    return _virtualCursor;
+  
+  // The sample offset is relative to the oldest buffer still queued
+  ALint offset;
+  alGetSourcei(_alSource, AL_SAMPLE_OFFSET, &offset);
+  double value;
+  if (_isSample)
+    value = _rate ? static_cast<double>(offset) / _rate : 0.0;
+  else if (_numOfQueued > 0)
+    value = _queuedTimes[_queuedHead] + (_rate ? static_cast<double>(offset) / _rate : 0.0);
+  else
+    value = _streamCursor;
+  
+  // Loops rewind within a block, so the position may run past the end
+  if (_isLoopable && (_length > 0.0))
+    value = std::fmod(value, _length);
+  return value;
+}
+
+bool Audio::_isAudible() {
+  if (!_voice)
+    return false;
   ALint alState;
   alGetSourcei(_alSource, AL_SOURCE_STATE, &alState);
+  return alState == AL_PLAYING;
+}
+
+// Called with the audio mutex held, whenever the source may have moved
+void Audio::_publishCursor() {
+  double cursor = _cursor();
+  bool isAudible = _isAudible();
+  Uint64 time = SDL_GetPerformanceCounter();
+  SDL_AtomicLock(&_cursorLock);
+  _publishedCursor = cursor;
+  _publishedTime = time;
+  _publishedLength = _length;
+  _isPublishedAudible = isAudible;
+  _isPublishedLoopable = _isLoopable;
+  SDL_AtomicUnlock(&_cursorLock);
+}
+
+// Called without the audio mutex held, as posting may have to wait for the
+// audio thread to make room, and that thread needs the mutex to get there
+void Audio::_post(AudioCommand &command) {
+  command.audio = this;
+  if (!AudioManager::instance().post(command))
+    this->execute(command);
+}
+
+ALuint Audio::_decodeSample() {
+  std::size_t length = static_cast<std::size_t>(ov_pcm_total(&_oggStream, -1)) *
+                       _channels * 2;
+  if (!length)
+    return 0;
+  
+  std::vector<char> data(length);
+  std::size_t size = 0;
+  while (size < length) {
+    int section;
+    long result = ov_read(&_oggStream, &data[size], static_cast<int>(length - size),
+                          0, 2, 1, &section);
+    if (result > 0) {
+      size += static_cast<std::size_t>(result);
+    } else if (result == 0) {
+      // EOF
+      break;
+    } else if (result == OV_HOLE) {
+      continue;
+    } else {
+      // Rewind and let the clip stream as usual
+      ov_raw_seek(&_oggStream, 0);
+      return 0;
+    }
+  }
+  
+  ALuint buffer;
+  alGenBuffers(1, &buffer);
+  alBufferData(buffer, _alFormat, &data[0], static_cast<ALsizei>(size), _rate);
+  if (!_verifyError("sample")) {
+    alDeleteBuffers(1, &buffer);
+    ov_raw_seek(&_oggStream, 0);
+    return 0;
+  }
+  return buffer;
+}
+
+void Audio::_queueBuffers() {
+  // Take back the buffers OpenAL is done with
+  ALint processed;
+  alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &processed);
+  Uint64 now = SDL_GetPerformanceCounter();
+  while (processed--) {
+    ALuint buffer;
+    alSourceUnqueueBuffers(_alSource, 1, &buffer);
+    _freeTimes[_numOfFreeBuffers] = now;
+    _freeBuffers[_numOfFreeBuffers++] = buffer;
+    
+    if (_numOfQueued > 0) {
+      _streamCursor = _queuedTimes[_queuedHead] + _queuedLengths[_queuedHead];
+      _queuedHead = (_queuedHead + 1) % kMaxAudioBuffers;
+      _numOfQueued--;
+    }
+  }
+  
+  bool hasConsumed = false;
+  if (SDL_LockMutex(_streamMutex) == 0) {
+    while ((_numOfFreeBuffers > 0) && (_ringFilled > 0) && !_isQueueEnded) {
+      int size = _ringSizes[_ringRead];
+      if (size > 0) {
+        ALuint buffer = _freeBuffers[--_numOfFreeBuffers];
+        alBufferData(buffer, _alFormat, _ring + (_ringRead * _bufferSize), size, _rate);
+        
+        // Sampled again here so that waiting on the stream mutex counts too
+        Uint64 queuedTime = SDL_GetPerformanceCounter();
+        alSourceQueueBuffers(_alSource, 1, &buffer);
+        
+        int tail = (_queuedHead + _numOfQueued) % kMaxAudioBuffers;
+        _queuedTimes[tail] = _ringTimes[_ringRead];
+        _queuedLengths[tail] = static_cast<double>(size) / (_rate * _channels * 2);
+        _numOfQueued++;
+        
+        double latency = (queuedTime - _freeTimes[_numOfFreeBuffers]) * 1000.0 /
+                         SDL_GetPerformanceFrequency();
+        SDL_AtomicLock(&_statsLock);
+        _stats.refills++;
+        _stats.refillLatency += latency;
+        SDL_AtomicUnlock(&_statsLock);
+      }
+      
+      if (_ringEnds[_ringRead])
+        _isQueueEnded = true;
+      _ringRead = (_ringRead + 1) % _numOfBuffers;
+      _ringFilled--;
+      hasConsumed = true;
+    }
+    SDL_UnlockMutex(_streamMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
   
-  if (alState != AL_PLAYING) {
-    int queued;
-    alGetSourcei(_alSource, AL_BUFFERS_PROCESSED, &queued);
+  if (hasConsumed)
+    AudioManager::instance().requestDecode(this);
+}
+
+void Audio::_resetVoice() {
+  // Take every buffer back from the source, leaving the decode ring alone
+  alSourceStop(_alSource);
+  alSourcei(_alSource, AL_BUFFER, 0);
+  _isSyncing = false;
+  _queuedHead = 0;
+  _numOfQueued = 0;
+  Uint64 now = SDL_GetPerformanceCounter();
+  for (_numOfFreeBuffers = 0; _numOfFreeBuffers < _numOfBuffers; _numOfFreeBuffers++) {
+    _freeBuffers[_numOfFreeBuffers] = _voice->buffers[_numOfFreeBuffers];
+    _freeTimes[_numOfFreeBuffers] = now;
+  }
+  _hasStarted = false;
+}
+
+void Audio::_restartStream(double time) {
+  // Drop everything queued or decoded and start over from the given time
+  _resetVoice();
+  _rewindStream(time);
+}
+
+bool Audio::_isStreamAt(double time) {
+  bool value = false;
+  if (SDL_LockMutex(_streamMutex) == 0) {
+    // The oldest block not yet handed to OpenAL, or the next to be decoded
+    double position = (_ringFilled > 0) ? _ringTimes[_ringRead] : _decodeCursor;
+    value = !_hasStreamingError && !_isQueueEnded && !_ringOffset &&
+            (std::fabs(position - time) < kAudioSyncTolerance);
+    SDL_UnlockMutex(_streamMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  return value;
+}
+
+void Audio::_rewindStream(double time) {
+  _hasStarted = false;
+  _streamCursor = time;
+  _virtualCursor = time;
+  if (SDL_LockMutex(_streamMutex) == 0) {
+    // A decoder thread may be reading the stream, so it seeks before its
+    // next block instead
+    _hasPendingSeek = true;
+    _seekTime = time;
+    _decodeCursor = time;
+    _ringGeneration++;
+    _ringIndex = 0;
+    _ringRead = 0;
+    _ringFilled = 0;
+    _ringOffset = 0;
+    _isStreamEnded = false;
+    _isQueueEnded = false;
+    SDL_UnlockMutex(_streamMutex);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+  
+  AudioManager::instance().requestDecode(this);
+}
+
+void Audio::_resync(double time) {
+  if (_isSample) {
+    // The whole clip is already there, so it can start right away
+    alSourceStop(_alSource);
+    double offset = _distance(0.0, time);
+    if (_isLoopable || (offset < _length)) {
+      alSourcei(_alSource, AL_SAMPLE_OFFSET, static_cast<ALint>(offset * _rate));
+      alSourcePlay(_alSource);
+    }
+  } else {
+    // Seek far enough ahead for the decoders to catch up, then wait there.
+    // When both start together there's nothing to catch up with.
+    int bytesPerSecond = _rate * _channels * 2;
+    double lead = 0.0;
+    if ((bytesPerSecond > 0) && _matchedAudio->isAudible())
+      lead = static_cast<double>(2 * _bufferSize) / bytesPerSecond;
+    _syncTime = time + lead;
+    if (_isLoopable && (_length > 0.0))
+      _syncTime = std::fmod(_syncTime, _length);
+    _restartStream(_syncTime);
+    _isSyncing = true;
+  }
+}
+
+double Audio::_distance(double from, double to) {
+  // Shortest way around for loops
+  double value = to - from;
+  if (_isLoopable && (_length > 0.0)) {
+    value = std::fmod(value, _length);
+    if (value > _length / 2.0)
+      value -= _length;
+    else if (value < -_length / 2.0)
+      value += _length;
+  }
+  return value;
+}
+
+void Audio::_accumulate(float* buffer, const short* samples, int frames,
+                        int channels, float gain, float step) {
+  // Adds 16-bit samples to an interleaved stereo buffer. Mono is copied to
+  // both channels.
+  int i = 0;
+#ifdef DAGON_SSE2
+  __m128 gains = _mm_setr_ps(gain, gain, gain + step, gain + step);
+  __m128 steps = _mm_set1_ps(step * 2.0f);
+  for (; (i + 4) <= frames; i += 4) {
+    __m128i data;
+    if (channels == 2) {
+      data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + (i * 2)));
+    } else {
+      data = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + i));
+      data = _mm_unpacklo_epi16(data, data);
+    }
     
-    while (queued--) {
-      ALuint buffer;
-      alSourceUnqueueBuffers(_alSource, 1, &buffer);
-      _verifyError("unqueue");
+    // Sign-extend to 32 bits, two frames at a time
+    __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(data, data), 16));
+    __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(data, data), 16));
+    float* out = buffer + (i * 2);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(low, gains)));
+    gains = _mm_add_ps(gains, steps);
+    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(high, gains)));
+    gains = _mm_add_ps(gains, steps);
+  }
+  gain += step * i;
+#endif
+  for (; i < frames; i++) {
+    if (channels == 2) {
+      buffer[i * 2] += samples[i * 2] * gain;
+      buffer[(i * 2) + 1] += samples[(i * 2) + 1] * gain;
+    } else {
+      buffer[i * 2] += samples[i] * gain;
+      buffer[(i * 2) + 1] += samples[i] * gain;
     }
+    gain += step;
   }
 }
 
@@ -444,6 +1375,9 @@ std::size_t Audio::_oggRead(void* ptr, std::size_t size, std::size_t nmemb,
   Audio* audio = static_cast<Audio*>(datasource);
   std::size_t nSize = size * nmemb;
   
+  if (audio->_resource.file)
+    return std::fread(ptr, 1, nSize, audio->_resource.file);
+  
   if ((audio->_resource.dataRead + nSize) > audio->_resource.dataSize)
     nSize = audio->_resource.dataSize - audio->_resource.dataRead;
   
@@ -455,6 +1389,9 @@ std::size_t Audio::_oggRead(void* ptr, std::size_t size, std::size_t nmemb,
 int Audio::_oggSeek(void* datasource, ogg_int64_t offset, int whence) {
   Audio* audio = static_cast<Audio*>(datasource);
   
+  if (audio->_resource.file)
+    return std::fseek(audio->_resource.file, static_cast<long>(offset), whence);
+  
   switch (whence) {
     case SEEK_SET: {
       audio->_resource.dataRead = offset;
@@ -483,12 +1420,18 @@ int Audio::_oggSeek(void* datasource, ogg_int64_t offset, int whence) {
 
 int Audio::_oggClose(void* datasource) {
   Audio* audio = static_cast<Audio*>(datasource);
+  if (audio->_resource.file) {
+    std::fclose(audio->_resource.file);
+    audio->_resource.file = NULL;
+  }
   audio->_resource.dataRead = 0;
   return 0;
 }
 
 long Audio::_oggTell(void* datasource) {
   Audio* audio = static_cast<Audio*>(datasource);
+  if (audio->_resource.file)
+    return std::ftell(audio->_resource.file);
   return audio->_resource.dataRead;
 }
   
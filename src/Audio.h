@@ -18,6 +18,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <cstdio>
 #include <string>
 
 #include "Config.h"
@@ -34,6 +35,7 @@
 #include <ogg/ogg.h>
 #include <vorbis/codec.h>
 #include <vorbis/vorbisfile.h>
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
 
 #include "Defines.h"
@@ -53,12 +55,15 @@ class Log;
 // Definitions
 ////////////////////////////////////////////////////////////
 
-enum AudioBufferState {
-  kAudioStreamEOF = -1,
-  kAudioStreamError = -2,
-  kAudioGenericError = -3,
-  kAudioStreamOK = 1
-};
+// Files larger than this are streamed from disk instead of read into memory
+#define kAudioStreamSize 262144
+#define kAudioReadSize 32768
+
+// Longest the audio thread sleeps when nothing needs a refill (in milliseconds)
+#define kAudioIdleTimeout 100
+
+// Matched audios further apart than this are realigned (in seconds)
+#define kAudioSyncTolerance 0.005
 
 enum AudioStates {
   kAudioInitial,
@@ -67,10 +72,56 @@ enum AudioStates {
   kAudioStopped
 };
 
+// Higher priorities steal voices from lower ones when the pool runs out
+enum AudioPriorities {
+  kAudioPriorityAmbient = 0,
+  kAudioPrioritySound,
+  kAudioPriorityFeed
+};
+
+enum AudioCommands {
+  kAudioCommandPlay,
+  kAudioCommandPause,
+  kAudioCommandStop,
+  kAudioCommandPosition,
+  kAudioCommandOrientation
+};
+
+class Audio;
+
+// One OpenAL source and its streaming buffers, allocated once by the
+// manager and lent to playing audios
+struct AudioVoice {
+  ALuint source;
+  ALuint buffers[kMaxAudioBuffers];
+};
+
+struct AudioCommand {
+  int type;
+  Audio* audio;
+  unsigned int face;
+  Point origin;
+  float orientation[6];
+};
+
+// Streaming counters, kept for as long as the audio exists. Times are in
+// milliseconds; queue depths are in buffers.
+struct AudioStats {
+  int underruns; // Times a source ran dry before its stream ended
+  int blocks;
+  double decodeTime;
+  int refills;
+  double refillLatency; // From OpenAL reporting a buffer processed to it being requeued
+  int queueDepth;
+  int minQueueDepth;
+  int streams; // Streams currently playing, set when aggregating
+};
+
 struct Resource {
   int index;
   std::string name;
   char* data;
+  std::FILE* file;
   std::size_t dataRead;
   std::size_t dataSize;
 };
@@ -86,18 +137,22 @@ class Audio : public Object {
   
   // Checks
   bool doesAutoplay();
+  bool hasVoice();
   bool isLoaded();
   bool isLoopable();
   bool isPlaying();
   
   // Gets
-  double cursor(); // For match function
+  double cursor(); // Audible position, safe to read from any thread
+  double length(); // In seconds, zero if unknown, safe from any thread
+  int priority();
   int state();
   
   // Sets
   void setAutoplay(bool autoplay);
   void setLoopable(bool loopable);
   void setPosition(unsigned int face, Point origin);
+  void setPriority(int priority);
   void setResource(std::string fileName);
   
   // State changes
@@ -107,7 +162,26 @@ class Audio : public Object {
   void pause();
   void stop();
   void unload();
-  void update();
+  int update(); // Returns milliseconds until the next update is due
+  
+  // Carried out by the audio thread
+  void execute(const AudioCommand &command);
+  bool attachVoice(AudioVoice* voice);
+  AudioVoice* detachVoice();
+  bool isAudible(); // Safe to read from any thread
+  int sync(); // Returns milliseconds until the next check is due
+  
+  // Mixed audios have no voice of their own. The manager pulls their
+  // decoded blocks into the ambient bus instead.
+  bool isMixed();
+  void setMixed(bool mixed);
+  void mix(float* buffer, int frames);
+  
+  // Carried out by the decoder threads
+  void decode();
+  
+  // Adds this audio's counters to the given totals
+  void collectStats(AudioStats* stats);
   
  private:
   Config& config;
@@ -115,6 +189,7 @@ class Audio : public Object {
   
   Audio* _matchedAudio;
   SDL_mutex* _mutex;
+  SDL_mutex* _streamMutex; // Guards the decode ring, never held while decoding
   
   // Eventually all file management will be handled by a separate class
   Resource _resource;
@@ -123,21 +198,114 @@ class Audio : public Object {
   bool _isLoaded;
   bool _isLoopable;
   bool _isMatched;
+  bool _isMixed;
+  bool _isSample;
+  int _pendingCommands;
+  int _priority;
   int _state;
   
-  ALuint _alBuffers[kMaxAudioBuffers];
+  // Without a voice the audio is virtual: it keeps advancing its cursor so
+  // that it resumes in the right place once a source is available again
+  AudioVoice* _voice;
+  double _virtualCursor;
+  Uint32 _virtualTime;
+  
+  int _numOfBuffers;
 	ALenum _alFormat;
   ALuint _alSource;
   int _channels;
+  double _length;
   ALsizei _rate;
+  std::string _sampleFile;
+  ALuint _sample;
+  
+  bool _hasPosition;
+  unsigned int _face;
+  Point _origin;
+  
+  // Decode slots for streaming, allocated once per load. Decoder threads
+  // fill them ahead of time and the audio thread hands them to OpenAL.
+  char* _ring;
+  int _bufferSize;
+  int _ringIndex;
+  int _ringRead;
+  int _ringFilled;
+  int _ringSizes[kMaxAudioBuffers];
+  bool _ringEnds[kMaxAudioBuffers];
+  int _ringOffset; // Bytes of the oldest block already mixed
+  float _mixGain;
+  bool _hasStreamingError;
+  bool _isStreamEnded;
+  bool _isQueueEnded;
+  bool _hasStarted;
+  
+  // One decoder thread at a time owns the Vorbis stream and the slot at the
+  // write index, and reads into it without the stream mutex. Rewinds leave
+  // the seek to that thread and bump the generation, so that a block read
+  // from the old position is thrown away.
+  bool _isDecoding;
+  bool _hasPendingSeek;
+  double _seekTime;
+  double _decodeCursor; // Where the next block starts
+  int _ringGeneration;
+  
+  // Where each queued buffer starts in the stream, oldest first, so that
+  // the audible position is exact rather than the decoder's
+  double _queuedTimes[kMaxAudioBuffers];
+  double _queuedLengths[kMaxAudioBuffers];
+  double _ringTimes[kMaxAudioBuffers];
+  int _queuedHead;
+  int _numOfQueued;
+  double _streamCursor;
+  
+  // Snapshot of the audible position taken by the audio thread, so that
+  // matched audios and videos never touch our source directly
+  SDL_SpinLock _cursorLock;
+  double _publishedCursor;
+  double _publishedLength;
+  Uint64 _publishedTime;
+  bool _isPublishedAudible;
+  bool _isPublishedLoopable;
+  
+  // Matched audios wait with their first blocks queued until the audio
+  // they follow reaches this time
+  bool _isSyncing;
+  double _syncTime;
+  
+  // Voice buffers not currently queued on the source, and when they were
+  // handed back to us
+  ALuint _freeBuffers[kMaxAudioBuffers];
+  Uint64 _freeTimes[kMaxAudioBuffers];
+  int _numOfFreeBuffers;
+  
+  // Guarded by a spinlock of their own rather than the audio or stream
+  // mutex. Streams is set while this audio plays a stream on a voice.
+  SDL_SpinLock _statsLock;
+  AudioStats _stats;
   
   ov_callbacks _oggCallbacks;
   OggVorbis_File _oggStream;
   
   // Private methods
-  int _fillBuffer(ALuint* buffer);
-  void _emptyBuffers();
+  void _play();
+  void _pause();
+  void _stop();
+  void _setPosition(unsigned int face, Point origin);
+  double _cursor();
+  bool _isAudible();
+  void _publishCursor();
+  void _post(AudioCommand &command);
+  ALuint _decodeSample();
+  void _queueBuffers();
+  void _resetVoice();
+  void _restartStream(double time);
+  bool _isStreamAt(double time);
+  void _rewindStream(double time);
+  void _resync(double time);
+  double _distance(double from, double to);
   std::string _randomizeFile(const std::string &fileName);
+  static void _accumulate(float* buffer, const short* samples, int frames,
+                          int channels, float gain, float step);
   ALboolean _verifyError(const std::string &operation);
   
   // Callbacks for Vorbisfile library
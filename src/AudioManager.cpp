@@ -21,6 +21,10 @@
 #include "Config.h"
 #include "Log.h"
 
+#ifdef DAGON_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace dagon {
 
 ////////////////////////////////////////////////////////////
@@ -33,9 +37,24 @@ log(Log::instance())
 {
   _isInitialized = false;
   _isRunning = false;
+  _numOfVoices = 0;
+  _busVoice = NULL;
+  _numOfFreeBusBuffers = 0;
+  _samplesLock = 0;
+  _voicesLock = 0;
+  _timeout = kAudioIdleTimeout;
+  SDL_AtomicSet(&_commandsRead, 0);
+  SDL_AtomicSet(&_commandsWritten, 0);
   _mutex = SDL_CreateMutex();
   if (!_mutex)
     log.error(kModAudio, "%s", kString18001);
+  _decodeMutex = SDL_CreateMutex();
+  if (!_decodeMutex)
+    log.error(kModAudio, "%s", kString18001);
+  _semaphore = SDL_CreateSemaphore(0);
+  _decodeSemaphore = SDL_CreateSemaphore(0);
+  if (!_semaphore || !_decodeSemaphore)
+    log.error(kModAudio, "%s", kString18004);
 }
 
 ////////////////////////////////////////////////////////////
@@ -43,6 +62,9 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 AudioManager::~AudioManager() {
+  SDL_DestroySemaphore(_decodeSemaphore);
+  SDL_DestroySemaphore(_semaphore);
+  SDL_DestroyMutex(_decodeMutex);
   SDL_DestroyMutex(_mutex);
 }
 
@@ -50,6 +72,41 @@ AudioManager::~AudioManager() {
 // Implementation
 ////////////////////////////////////////////////////////////
 
+AudioVoice* AudioManager::acquireVoice() {
+  AudioVoice* voice = NULL;
+  SDL_AtomicLock(&_voicesLock);
+  if (!_arrayOfFreeVoices.empty()) {
+    voice = _arrayOfFreeVoices.back();
+    _arrayOfFreeVoices.pop_back();
+  }
+  SDL_AtomicUnlock(&_voicesLock);
+  return voice;
+}
+
+void AudioManager::cancelDecode(Audio* target) {
+  bool isDecoding = true;
+  while (isDecoding) {
+    if (SDL_LockMutex(_decodeMutex) == 0) {
+      std::vector<Audio*>::iterator it = std::find(_arrayOfDecodeJobs.begin(),
+                                                   _arrayOfDecodeJobs.end(), target);
+      if (it != _arrayOfDecodeJobs.end())
+        _arrayOfDecodeJobs.erase(it);
+      
+      // A decoder thread may have taken the job already, in which case the
+      // caller can't free the stream until it's done
+      isDecoding = std::find(_arrayOfDecodingAudios.begin(), _arrayOfDecodingAudios.end(),
+                             target) != _arrayOfDecodingAudios.end();
+      SDL_UnlockMutex(_decodeMutex);
+    } else {
+      log.error(kModAudio, "%s", kString18002);
+      isDecoding = false;
+    }
+    
+    if (isDecoding)
+      SDL_Delay(1);
+  }
+}
+
 void AudioManager::clear() {
   if (_isInitialized) {
     if (!_arrayOfActiveAudios.empty()) {
@@ -207,6 +264,35 @@ void AudioManager::init() {
     return;
   }
   
+  // Allocate every voice now, as many as the device allows
+  _arrayOfFreeVoices.reserve(kMaxNumberOfVoices);
+  for (_numOfVoices = 0; _numOfVoices < kMaxNumberOfVoices; _numOfVoices++) {
+    AudioVoice* voice = &_voices[_numOfVoices];
+    alGenSources(1, &voice->source);
+    if (alGetError() != AL_NO_ERROR)
+      break;
+    
+    alGenBuffers(kMaxAudioBuffers, voice->buffers);
+    if (alGetError() != AL_NO_ERROR) {
+      alDeleteSources(1, &voice->source);
+      break;
+    }
+    _arrayOfFreeVoices.push_back(voice);
+  }
+  
+  // The ambient bus keeps one voice for itself
+  if (config.ambientBus) {
+    _busVoice = this->acquireVoice();
+    if (_busVoice) {
+      alSourcei(_busVoice->source, AL_SOURCE_RELATIVE, AL_TRUE);
+      alSource3f(_busVoice->source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+      alSourcei(_busVoice->source, AL_LOOPING, AL_FALSE);
+      for (_numOfFreeBusBuffers = 0; _numOfFreeBusBuffers < kAudioBusBuffers;
+           _numOfFreeBusBuffers++)
+        _freeBusBuffers[_numOfFreeBusBuffers] = _busVoice->buffers[_numOfFreeBusBuffers];
+    }
+  }
+  
   log.info(kModAudio, "%s: %s", kString16002, alGetString(AL_VERSION));
   log.info(kModAudio, "%s: %s", kString16003, vorbis_version_string());
   
@@ -217,20 +303,57 @@ void AudioManager::init() {
   if (!_thread) {
     log.error(kModAudio, "%s:%s", kString18003, SDL_GetError());
   }
+  
+  for (int i = 0; i < kAudioDecodeThreads; i++) {
+    _decodeThreads[i] = SDL_CreateThread(_runDecodeThread, "AudioDecoder", (void*)NULL);
+    if (!_decodeThreads[i]) {
+      log.error(kModAudio, "%s:%s", kString18003, SDL_GetError());
+    }
+  }
+}
+
+bool AudioManager::post(const AudioCommand &command) {
+  if (!_isRunning)
+    return false;
+  
+  int written = SDL_AtomicGet(&_commandsWritten);
+  int next = (written + 1) % kMaxAudioCommands;
+  while (next == SDL_AtomicGet(&_commandsRead)) {
+    // Queue is full. Running the command here could overtake older ones for
+    // the same audio, so we wake the audio thread and wait for room.
+    if (!_isRunning)
+      return false;
+    SDL_SemPost(_semaphore);
+    SDL_Delay(1);
+  }
+  
+  _commands[written] = command;
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&_commandsWritten, next);
+  SDL_SemPost(_semaphore);
+  return true;
 }
 
 void AudioManager::registerAudio(Audio* target) {
   _arrayOfAudios.push_back(target);
 }
 
+void AudioManager::releaseVoice(AudioVoice* voice) {
+  SDL_AtomicLock(&_voicesLock);
+  _arrayOfFreeVoices.push_back(voice);
+  SDL_AtomicUnlock(&_voicesLock);
+}
+
 void AudioManager::requestAudio(Audio* target) {
-  if (_arrayOfActiveAudios.size() >= kMaxNumberOfAudios) 
-	  return;
-  
+  // Audios beyond the number of voices are simply virtual until one frees up
   if (!target->isLoaded()) {
     target->load();
   }
   target->retain();
+  
+  // Must be decided before the audio thread gets a chance to give it a voice
+  if (_busVoice && (target->priority() == kAudioPriorityAmbient))
+    target->setMixed(true);
 
   bool isActive = false;
   isActive = std::find(_arrayOfActiveAudios.begin(), _arrayOfActiveAudios.end(),
@@ -253,10 +376,110 @@ void AudioManager::requestAudio(Audio* target) {
   }
 }
 
+ALuint AudioManager::registerSample(const std::string &fileName, ALuint buffer) {
+  SDL_AtomicLock(&_samplesLock);
+  std::map<std::string, AudioSample>::iterator cached = _mapOfSamples.find(fileName);
+  if (cached != _mapOfSamples.end()) {
+    // Another audio decoded the same clip meanwhile, so we keep the first
+    // buffer as it may already be referenced
+    (*cached).second.references++;
+    ALuint existing = (*cached).second.buffer;
+    SDL_AtomicUnlock(&_samplesLock);
+    alDeleteBuffers(1, &buffer);
+    return existing;
+  }
+  
+  if (_mapOfSamples.size() >= kMaxNumberOfSamples) {
+    std::map<std::string, AudioSample>::iterator it = _mapOfSamples.begin();
+    while (it != _mapOfSamples.end()) {
+      if ((*it).second.references == 0) {
+        alDeleteBuffers(1, &(*it).second.buffer);
+        _mapOfSamples.erase(it);
+        break;
+      }
+      ++it;
+    }
+  }
+  
+  AudioSample sample;
+  sample.buffer = buffer;
+  sample.references = 1;
+  _mapOfSamples[fileName] = sample;
+  SDL_AtomicUnlock(&_samplesLock);
+  return buffer;
+}
+
+void AudioManager::releaseSample(const std::string &fileName) {
+  SDL_AtomicLock(&_samplesLock);
+  std::map<std::string, AudioSample>::iterator it = _mapOfSamples.find(fileName);
+  if (it != _mapOfSamples.end()) {
+    if ((*it).second.references > 0)
+      (*it).second.references--;
+  }
+  SDL_AtomicUnlock(&_samplesLock);
+}
+
+ALuint AudioManager::retainSample(const std::string &fileName) {
+  ALuint buffer = 0;
+  SDL_AtomicLock(&_samplesLock);
+  std::map<std::string, AudioSample>::iterator it = _mapOfSamples.find(fileName);
+  if (it != _mapOfSamples.end()) {
+    (*it).second.references++;
+    buffer = (*it).second.buffer;
+  }
+  SDL_AtomicUnlock(&_samplesLock);
+  return buffer;
+}
+
+void AudioManager::requestDecode(Audio* target) {
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    bool isQueued = std::find(_arrayOfDecodeJobs.begin(), _arrayOfDecodeJobs.end(),
+                              target) != _arrayOfDecodeJobs.end();
+    if (!isQueued)
+      _arrayOfDecodeJobs.push_back(target);
+    SDL_UnlockMutex(_decodeMutex);
+    
+    if (!isQueued)
+      SDL_SemPost(_decodeSemaphore);
+  } else {
+    log.error(kModAudio, "%s", kString18002);
+  }
+}
+
 void AudioManager::setOrientation(float* orientation) {
   if (_isInitialized) {
-    alListenerfv(AL_ORIENTATION, orientation);
+    AudioCommand command;
+    command.type = kAudioCommandOrientation;
+    command.audio = NULL;
+    for (int i = 0; i < 6; i++)
+      command.orientation[i] = orientation[i];
+    if (!this->post(command))
+      alListenerfv(AL_ORIENTATION, orientation);
+  }
+}
+
+AudioStats AudioManager::stats() {
+  AudioStats stats;
+  stats.underruns = 0;
+  stats.blocks = 0;
+  stats.decodeTime = 0.0;
+  stats.refills = 0;
+  stats.refillLatency = 0.0;
+  stats.queueDepth = kMaxAudioBuffers;
+  stats.minQueueDepth = kMaxAudioBuffers;
+  stats.streams = 0;
+  
+  std::vector<Audio*>::iterator it = _arrayOfAudios.begin();
+  while (it != _arrayOfAudios.end()) {
+    (*it)->collectStats(&stats);
+    ++it;
+  }
+  
+  if (!stats.streams) {
+    stats.queueDepth = 0;
+    stats.minQueueDepth = 0;
   }
+  return stats;
 }
 
 void AudioManager::terminate() {
@@ -266,10 +489,18 @@ void AudioManager::terminate() {
   // Each audio object should unregister itself if
   // destroyed
   _isRunning = false;
+  SDL_SemPost(_semaphore);
   
   int threadReturnValue;
   SDL_WaitThread(_thread, &threadReturnValue);
   
+  for (int i = 0; i < kAudioDecodeThreads; i++)
+    SDL_SemPost(_decodeSemaphore);
+  for (int i = 0; i < kAudioDecodeThreads; i++) {
+    if (_decodeThreads[i])
+      SDL_WaitThread(_decodeThreads[i], &threadReturnValue);
+  }
+  
   if (!_arrayOfAudios.empty()) {
     if (SDL_LockMutex(_mutex) == 0) {
       std::vector<Audio*>::iterator it = _arrayOfAudios.begin();
@@ -284,6 +515,20 @@ void AudioManager::terminate() {
     }
   }
   
+  // Every audio is unloaded at this point, so no sample is referenced
+  std::map<std::string, AudioSample>::iterator it = _mapOfSamples.begin();
+  while (it != _mapOfSamples.end()) {
+    alDeleteBuffers(1, &(*it).second.buffer);
+    ++it;
+  }
+  _mapOfSamples.clear();
+  
+  for (int i = 0; i < _numOfVoices; i++) {
+    alDeleteSources(1, &_voices[i].source);
+    alDeleteBuffers(kMaxAudioBuffers, _voices[i].buffers);
+  }
+  _arrayOfFreeVoices.clear();
+  
   // Now we shut down OpenAL completely
   if (_isInitialized) {
     alcMakeContextCurrent(NULL);
@@ -295,13 +540,40 @@ void AudioManager::terminate() {
 // Asynchronous method
 bool AudioManager::update() {
   if (_isRunning) {
+    // Carry out every command posted since the last update
+    int read = SDL_AtomicGet(&_commandsRead);
+    while (read != SDL_AtomicGet(&_commandsWritten)) {
+      SDL_MemoryBarrierAcquire();
+      const AudioCommand &command = _commands[read];
+      if (command.type == kAudioCommandOrientation)
+        alListenerfv(AL_ORIENTATION, command.orientation);
+      else
+        command.audio->execute(command);
+      read = (read + 1) % kMaxAudioCommands;
+      SDL_AtomicSet(&_commandsRead, read);
+    }
+    
+    _timeout = kAudioIdleTimeout;
     if (!_arrayOfActiveAudios.empty()) {
       if (SDL_LockMutex(_mutex) == 0) {
+        _assignVoices();
+        
         std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
         while (it != _arrayOfActiveAudios.end()) {
-          (*it)->update();
+          int timeout = (*it)->update();
+          if (timeout < _timeout)
+            _timeout = timeout;
+          
+          // Matched audios follow the audible position of their leader
+          timeout = (*it)->sync();
+          if (timeout < _timeout)
+            _timeout = timeout;
           ++it;
         }
+        
+        int timeout = _updateBus();
+        if (timeout < _timeout)
+          _timeout = timeout;
         SDL_UnlockMutex(_mutex);
       } else {
         log.error(kModAudio, "%s", kString18002);
@@ -316,11 +588,166 @@ bool AudioManager::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
+void AudioManager::_assignVoices() {
+  std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+  while (it != _arrayOfActiveAudios.end()) {
+    if ((*it)->isPlaying() && !(*it)->hasVoice() && !(*it)->isMixed()) {
+      AudioVoice* voice = this->acquireVoice();
+      if (!voice) {
+        Audio* victim = _findVictim(*it);
+        if (victim)
+          voice = victim->detachVoice();
+      }
+      
+      if (voice) {
+        if (!(*it)->attachVoice(voice))
+          this->releaseVoice(voice);
+      }
+    }
+    ++it;
+  }
+}
+
+Audio* AudioManager::_findVictim(Audio* target) {
+  Audio* victim = NULL;
+  int victimPriority = 0;
+  float victimLevel = 0.0f;
+  
+  std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+  while (it != _arrayOfActiveAudios.end()) {
+    if (((*it) != target) && (*it)->hasVoice()) {
+      // Voices held by audios that aren't playing are taken first. Sources
+      // all sit at the same distance from the listener, so volume is what
+      // tells two audios of the same priority apart.
+      int priority = (*it)->isPlaying() ? (*it)->priority() : -1;
+      float level = (*it)->fadeLevel();
+      if (!victim || (priority < victimPriority) ||
+          ((priority == victimPriority) && (level < victimLevel))) {
+        victim = *it;
+        victimPriority = priority;
+        victimLevel = level;
+      }
+    }
+    ++it;
+  }
+  
+  if (victim) {
+    if ((victimPriority > target->priority()) ||
+        ((victimPriority == target->priority()) && (victimLevel >= target->fadeLevel())))
+      return NULL;
+  }
+  return victim;
+}
+
+int AudioManager::_runDecodeThread(void *ptr) {
+  AudioManager& audioManager = AudioManager::instance();
+  while (audioManager._isRunning) {
+    SDL_SemWaitTimeout(audioManager._decodeSemaphore, kAudioIdleTimeout);
+    
+    Audio* target = NULL;
+    if (SDL_LockMutex(audioManager._decodeMutex) == 0) {
+      if (!audioManager._arrayOfDecodeJobs.empty()) {
+        target = audioManager._arrayOfDecodeJobs.front();
+        audioManager._arrayOfDecodeJobs.erase(audioManager._arrayOfDecodeJobs.begin());
+        audioManager._arrayOfDecodingAudios.push_back(target);
+      }
+      SDL_UnlockMutex(audioManager._decodeMutex);
+    }
+    
+    if (target) {
+      target->decode();
+      
+      if (SDL_LockMutex(audioManager._decodeMutex) == 0) {
+        std::vector<Audio*>& decoding = audioManager._arrayOfDecodingAudios;
+        decoding.erase(std::find(decoding.begin(), decoding.end(), target));
+        SDL_UnlockMutex(audioManager._decodeMutex);
+      }
+      
+      // Let the audio thread hand the new blocks to OpenAL
+      SDL_SemPost(audioManager._semaphore);
+    }
+  }
+  return 0;
+}
+
 int AudioManager::_runThread(void *ptr) {
-  while (AudioManager::instance().update()) {
-    SDL_Delay(1);
+  AudioManager& audioManager = AudioManager::instance();
+  while (audioManager.update()) {
+    // Sleep until the next buffer is due or a command is posted
+    SDL_SemWaitTimeout(audioManager._semaphore, audioManager._timeout);
   }
   return 0;
 }
+
+int AudioManager::_updateBus() {
+  if (!_busVoice)
+    return kAudioIdleTimeout;
+  
+  ALuint source = _busVoice->source;
+  ALint processed;
+  alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+  while (processed--) {
+    ALuint buffer;
+    alSourceUnqueueBuffers(source, 1, &buffer);
+    _freeBusBuffers[_numOfFreeBusBuffers++] = buffer;
+  }
+  
+  bool hasMixed = false;
+  std::vector<Audio*>::iterator it = _arrayOfActiveAudios.begin();
+  while (it != _arrayOfActiveAudios.end()) {
+    if ((*it)->isMixed() && (*it)->isPlaying()) {
+      hasMixed = true;
+      break;
+    }
+    ++it;
+  }
+  
+  // The bus simply runs dry when no mixed audio is playing
+  while (hasMixed && (_numOfFreeBusBuffers > 0)) {
+    std::fill(_busMix, _busMix + (kAudioBusFrames * 2), 0.0f);
+    it = _arrayOfActiveAudios.begin();
+    while (it != _arrayOfActiveAudios.end()) {
+      (*it)->mix(_busMix, kAudioBusFrames);
+      ++it;
+    }
+    
+    // Clamp before converting, otherwise large values wrap around
+    int i = 0;
+#ifdef DAGON_SSE2
+    __m128 minimum = _mm_set1_ps(-32768.0f);
+    __m128 maximum = _mm_set1_ps(32767.0f);
+    for (; (i + 8) <= (kAudioBusFrames * 2); i += 8) {
+      __m128 low = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(_busMix + i), minimum), maximum);
+      __m128 high = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(_busMix + i + 4), minimum), maximum);
+      __m128i data = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(_busData + i), data);
+    }
+#endif
+    for (; i < (kAudioBusFrames * 2); i++) {
+      float sample = _busMix[i];
+      if (sample > 32767.0f)
+        sample = 32767.0f;
+      else if (sample < -32768.0f)
+        sample = -32768.0f;
+      _busData[i] = static_cast<short>(sample);
+    }
+    
+    ALuint buffer = _freeBusBuffers[--_numOfFreeBusBuffers];
+    alBufferData(buffer, AL_FORMAT_STEREO16, _busData, sizeof(_busData), kAudioBusRate);
+    alSourceQueueBuffers(source, 1, &buffer);
+  }
+  
+  ALint alState, queued;
+  alGetSourcei(source, AL_SOURCE_STATE, &alState);
+  alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+  if ((alState != AL_PLAYING) && (queued > 0))
+    alSourcePlay(source);
+  
+  if (!hasMixed)
+    return kAudioIdleTimeout;
+  
+  // Come back as soon as one block has been played
+  return (kAudioBusFrames * 1000) / kAudioBusRate;
+}
   
 }
@@ -18,6 +18,9 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <map>
+#include <string>
+
 #include "Audio.h"
 #include "Platform.h"
 
@@ -29,6 +32,7 @@
 #include <AL/alc.h>
 #endif
 
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
 #include <SDL2/SDL_thread.h>
 
@@ -38,11 +42,24 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
-#define kMaxNumberOfAudios 32
+#define kMaxNumberOfVoices 32
+#define kMaxNumberOfSamples 64
+#define kMaxAudioCommands 256
+#define kAudioDecodeThreads 2
+
+// Format of the ambient bus, which every mixed audio must share
+#define kAudioBusRate 44100
+#define kAudioBusFrames 2048
+#define kAudioBusBuffers 4
 
 class Config;
 class Log;
 
+struct AudioSample {
+  ALuint buffer;
+  int references;
+};
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
@@ -55,14 +72,48 @@ class AudioManager {
   ALCcontext* _alContext;
   SDL_mutex* _mutex;
   SDL_Thread* _thread;
+  SDL_sem* _semaphore;
+  
+  // Streams waiting for their rings to be filled by the decoder threads
+  SDL_Thread* _decodeThreads[kAudioDecodeThreads];
+  SDL_mutex* _decodeMutex;
+  SDL_sem* _decodeSemaphore;
+  std::vector<Audio*> _arrayOfDecodeJobs;
+  std::vector<Audio*> _arrayOfDecodingAudios; // Taken by a decoder thread
+  
+  // Single producer, single consumer queue: only the main thread posts
+  // and only the audio thread reads
+  AudioCommand _commands[kMaxAudioCommands];
+  SDL_atomic_t _commandsRead;
+  SDL_atomic_t _commandsWritten;
+  int _timeout;
   
   std::vector<Audio*> _arrayOfAudios;
   std::vector<Audio*> _arrayOfActiveAudios;
+  std::map<std::string, AudioSample> _mapOfSamples;
+  SDL_SpinLock _samplesLock;
+  
+  // Sources are allocated once at init and lent to playing audios
+  AudioVoice _voices[kMaxNumberOfVoices];
+  std::vector<AudioVoice*> _arrayOfFreeVoices;
+  int _numOfVoices;
+  SDL_SpinLock _voicesLock;
+  
+  // Room loops mixed in software and played through a single voice
+  AudioVoice* _busVoice;
+  ALuint _freeBusBuffers[kAudioBusBuffers];
+  int _numOfFreeBusBuffers;
+  float _busMix[kAudioBusFrames * 2];
+  short _busData[kAudioBusFrames * 2];
   
   bool _isInitialized;
   bool _isRunning;
   
+  void _assignVoices();
+  Audio* _findVictim(Audio* target);
+  static int _runDecodeThread(void *ptr);
   static int _runThread(void *ptr);
+  int _updateBus();
   
   AudioManager();
   AudioManager(AudioManager const&);
@@ -82,10 +133,34 @@ public:
   void clear();
   void flush();
   
+  void cancelDecode(Audio* target); // Also waits for a decode under way
   void init();
+  bool post(const AudioCommand &command); // Waits while the queue is full
   void registerAudio(Audio* target);
   void requestAudio(Audio* target);
+  void requestDecode(Audio* target);
+  
+  // Short clips are decoded once into a single buffer shared by every audio
+  // playing the same file. Unreferenced samples stay cached so that repeated
+  // effects such as footsteps never decode twice, and are only evicted when
+  // the cache is full. Registering a clip that is already cached deletes the
+  // given buffer and returns the cached one instead.
+  ALuint registerSample(const std::string &fileName, ALuint buffer);
+  void releaseSample(const std::string &fileName);
+  ALuint retainSample(const std::string &fileName);
+  
+  // Audios without a voice are virtual. When the pool runs out, a voice is
+  // stolen from the least important audio: silent ones first, then lower
+  // priorities, then the quietest.
+  AudioVoice* acquireVoice();
+  void releaseVoice(AudioVoice* voice);
+  
   void setOrientation(float* orientation);
+  
+  // Streaming counters summed across every registered audio. Queue depths
+  // are the lowest among the streams currently playing.
+  AudioStats stats();
+  
   void terminate();
   bool update();
 };
@@ -111,7 +111,7 @@ void Button::setAction(Action anAction) {
 
 void Button::setFont(const std::string &fromFileName,
                      unsigned int heightOfFont) {
-  // FIXME: Wrong, this can load many repeated fonts!
+  // Repeated fonts are shared by the manager
   _font = fontManager.load(fromFileName.c_str(), heightOfFont);
 }
 
@@ -119,6 +119,8 @@ void Button::setOnHoverTexture(const std::string &fromFileName) {
   // TODO: Important! We should determine first if the texture already exists,
   // to avoid repeating resources. Eventually, this would be done via the
   // resource manager.
+  if (_hasOnHoverTexture)
+    delete _onHoverTexture;
   _onHoverTexture = new Texture;
   _onHoverTexture->setResource(config.path(kPathResources, fromFileName,
                                            kObjectImage).c_str());
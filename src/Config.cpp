@@ -28,9 +28,11 @@ namespace dagon {
 ////////////////////////////////////////////////////////////
 
 Config::Config() {
+  ambientBus = kDefAmbientBus;
   antialiasing = kDefAntialiasing;
   audioBuffer = kDefAudioBuffer;
   audioDevice = kDefAudioDevice;
+  audioSampleLength = kDefAudioSampleLength;
   autopaths = kDefAutopaths;
   autorun = kDefAutorun;
   bundleEnabled = kDefBundleEnabled;
@@ -39,6 +41,7 @@ Config::Config() {
   displayHeight = kDefDisplayHeight;
   displayDepth = kDefDisplayDepth;
   debugMode = kDefDebugMode;
+  distanceFieldFonts = kDefDistanceFieldFonts;
   effects = kDefEffects;
   framebuffer = kDefFramebuffer;
   frameLimiter = kDefFrameLimiter;
@@ -54,6 +57,9 @@ Config::Config() {
   subtitles = kDefSubtitles;
   texCompression = kDefTexCompression;
   verticalSync = kDefVerticalSync;
+  videoQuality = kDefVideoQuality;
+  videoReadAhead = kDefVideoReadAhead;
+  videoShader = kDefVideoShader;
   _scriptName = kDefScriptFile;
   _resPath = kDefResourcePath;
   _texExtension = kDefTexExtension;
@@ -29,6 +29,7 @@ namespace dagon {
 ////////////////////////////////////////////////////////////
   
 #define kMaxAudioBuffers 16
+#define kMinAudioBuffers 2 // One playing while the other is refilled
 
 enum ControlModes {
   kControlDrag = 0,
@@ -37,9 +38,11 @@ enum ControlModes {
 };
 
 enum DefaultConfiguration {
+  kDefAmbientBus = false,
   kDefAntialiasing = false,
   kDefAudioBuffer = 8192,
   kDefAudioDevice = 0,
+  kDefAudioSampleLength = 2000,
   kDefAutopaths = true,
   kDefAutorun = true,
   kDefBundleEnabled = true,
@@ -48,6 +51,7 @@ enum DefaultConfiguration {
   kDefDisplayHeight = 0,
   kDefDisplayDepth = 32,
   kDefDebugMode = true,
+  kDefDistanceFieldFonts = false,
   kDefEffects = true,
   kDefFramebuffer = true,
   kDefFrameLimiter = false,
@@ -62,7 +66,10 @@ enum DefaultConfiguration {
   kDefSilentFeeds = false,
   kDefSubtitles = true,
   kDefTexCompression = false,
-  kDefVerticalSync = true
+  kDefVerticalSync = true,
+  kDefVideoQuality = 0,
+  kDefVideoReadAhead = 500,
+  kDefVideoShader = true
 };
 
 enum SystemPaths {
@@ -82,9 +89,11 @@ class Config {
     return config;
   }
   
+  bool ambientBus; // Mix room loops in software into a single source
   bool antialiasing;
   int audioBuffer;
   int audioDevice;
+  int audioSampleLength; // In milliseconds
   bool autopaths;
   bool autorun;
   bool bundleEnabled;
@@ -93,6 +102,7 @@ class Config {
   int displayHeight;
   int displayDepth;
   bool debugMode;
+  bool distanceFieldFonts;
   bool effects;
   bool framebuffer;
   bool frameLimiter;
@@ -108,6 +118,9 @@ class Config {
   bool subtitles;
   bool texCompression;
   bool verticalSync;
+  int videoQuality; // Post-processing level for videos, zero is fastest
+  int videoReadAhead; // Video data read at once, in milliseconds of playback
+  bool videoShader; // Convert video frames on the GPU
   
   double framesPerSecond();
   float globalSpeed();
@@ -37,6 +37,11 @@ namespace dagon {
 static int ConfigLibGet(lua_State *L) {
   const char *key = luaL_checkstring(L, 2);
   
+  if (strcmp(key, "ambientBus") == 0) {
+    lua_pushboolean(L, Config::instance().ambientBus);
+    return 1;
+  }
+  
   if (strcmp(key, "antialiasing") == 0) {
     lua_pushboolean(L, Config::instance().antialiasing);
     return 1;
@@ -52,6 +57,11 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "audioSampleLength") == 0) {
+    lua_pushnumber(L, Config::instance().audioSampleLength);
+    return 1;
+  }
+  
   if (strcmp(key, "autopaths") == 0) {
     lua_pushboolean(L, Config::instance().autopaths);
     return 1;
@@ -92,6 +102,11 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "distanceFieldFonts") == 0) {
+    lua_pushboolean(L, Config::instance().distanceFieldFonts);
+    return 1;
+  }
+  
   if (strcmp(key, "effects") == 0) {
     lua_pushboolean(L, Config::instance().effects);
     return 1;
@@ -172,12 +187,30 @@ static int ConfigLibGet(lua_State *L) {
     return 1;
   }
   
+  if (strcmp(key, "videoQuality") == 0) {
+    lua_pushnumber(L, Config::instance().videoQuality);
+    return 1;
+  }
+  
+  if (strcmp(key, "videoReadAhead") == 0) {
+    lua_pushnumber(L, Config::instance().videoReadAhead);
+    return 1;
+  }
+  
+  if (strcmp(key, "videoShader") == 0) {
+    lua_pushboolean(L, Config::instance().videoShader);
+    return 1;
+  }
+  
   return 0;
 }
 
 static int ConfigLibSet(lua_State *L) {
   const char *key = luaL_checkstring(L, 2);
   
+  if (strcmp(key, "ambientBus") == 0)
+    Config::instance().ambientBus = (bool)lua_toboolean(L, 3);
+  
   if (strcmp(key, "antialiasing") == 0)
     Config::instance().antialiasing = (bool)lua_toboolean(L, 3);
   
@@ -187,6 +220,9 @@ static int ConfigLibSet(lua_State *L) {
   if (strcmp(key, "audioDevice") == 0)
     Config::instance().audioDevice = (int)luaL_checknumber(L, 3);
   
+  if (strcmp(key, "audioSampleLength") == 0)
+    Config::instance().audioSampleLength = (int)luaL_checknumber(L, 3);
+  
   if (strcmp(key, "autopaths") == 0)
     Config::instance().autopaths = (bool)lua_toboolean(L, 3);
   
@@ -214,6 +250,9 @@ static int ConfigLibSet(lua_State *L) {
   if (strcmp(key, "debugMode") == 0)
     Config::instance().debugMode = (bool)lua_toboolean(L, 3);
   
+  if (strcmp(key, "distanceFieldFonts") == 0)
+    Config::instance().distanceFieldFonts = (bool)lua_toboolean(L, 3);
+  
   if (strcmp(key, "effects") == 0)
     Config::instance().effects = (bool)lua_toboolean(L, 3);
   
@@ -237,8 +276,10 @@ static int ConfigLibSet(lua_State *L) {
     
     if (numOfAudioBuffers > kMaxAudioBuffers)
       numOfAudioBuffers = kMaxAudioBuffers;
+    else if (numOfAudioBuffers < kMinAudioBuffers)
+      numOfAudioBuffers = kMinAudioBuffers;
     
-    Config::instance().numOfAudioBuffers = (int)luaL_checknumber(L, 3);
+    Config::instance().numOfAudioBuffers = numOfAudioBuffers;
   }
   
   if (strcmp(key, "script") == 0)
@@ -268,6 +309,15 @@ static int ConfigLibSet(lua_State *L) {
   if (strcmp(key, "verticalSync") == 0)
     Config::instance().verticalSync = (bool)lua_toboolean(L, 3);
   
+  if (strcmp(key, "videoQuality") == 0)
+    Config::instance().videoQuality = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "videoReadAhead") == 0)
+    Config::instance().videoReadAhead = (int)luaL_checknumber(L, 3);
+  
+  if (strcmp(key, "videoShader") == 0)
+    Config::instance().videoShader = (bool)lua_toboolean(L, 3);
+  
   return 0;
 }
 
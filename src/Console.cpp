@@ -15,6 +15,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include "AudioManager.h"
 #include "CameraManager.h"
 #include "Config.h"
 #include "Console.h"
@@ -22,6 +23,7 @@
 #include "Log.h"
 #include "FontManager.h"
 #include "RenderManager.h"
+#include "VideoManager.h"
 
 namespace dagon {
 
@@ -30,12 +32,14 @@ namespace dagon {
 ////////////////////////////////////////////////////////////
 
 Console::Console() :
+audioManager(AudioManager::instance()),
 cameraManager(CameraManager::instance()),
 config(Config::instance()),
 cursorManager(CursorManager::instance()),
 fontManager(FontManager::instance()),
 log(Log::instance()),
-renderManager(RenderManager::instance())
+renderManager(RenderManager::instance()),
+videoManager(VideoManager::instance())
 {
   _command = "";
   
@@ -127,6 +131,7 @@ void Console::toggle() {
 void Console::update() {
   if (_isEnabled) {
     Point position = cursorManager.position();
+    AudioStats stats;
     
     switch (_state) {
       case ConsoleHidden:
@@ -141,6 +146,15 @@ void Console::update() {
         _font->print(DGInfoMargin, (DGInfoMargin * 4) + (kDefFontSize * 3),
                      "FPS: %2.0f", config.framesPerSecond());
         
+        stats = audioManager.stats();
+        _font->print(DGInfoMargin, (DGInfoMargin * 5) + (kDefFontSize * 4),
+                     "Audio: %d underruns, %d/%d queued, %.2f ms decode, %.2f ms refill",
+                     stats.underruns, stats.queueDepth, stats.minQueueDepth,
+                     stats.blocks ? stats.decodeTime / stats.blocks : 0.0,
+                     stats.refills ? stats.refillLatency / stats.refills : 0.0);
+        _font->print(DGInfoMargin, (DGInfoMargin * 6) + (kDefFontSize * 5),
+                     "Video: %d dropped frames", videoManager.droppedFrames());
+        
         break;
       case ConsoleHiding:
         if (_offset < _size)
@@ -39,6 +39,7 @@ enum ConsoleStates {
   ConsoleVisible
 };
 
+class AudioManager;
 class CameraManager;
 class Config;
 class CursorManager;
@@ -46,18 +47,21 @@ class Font;
 class FontManager;
 class Log;
 class RenderManager;
+class VideoManager;
 
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
 
 class Console {
+  AudioManager& audioManager;
   CameraManager& cameraManager;
   Config& config;
   CursorManager& cursorManager;
   FontManager& fontManager;
   Log& log;
   RenderManager& renderManager;
+  VideoManager& videoManager;
   
   Font* _font;
   
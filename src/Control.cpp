@@ -70,6 +70,7 @@ videoManager(VideoManager::instance())
   
   _sleepTimer = 0;
   
+  _isCutscenePending = false;
   _isInitialized = false;
   _isShowingSplash = false;
   _isShuttingDown = false;
@@ -194,8 +195,9 @@ Room* Control::currentRoom() {
 }
 
 void Control::cutscene(const char* fileName) {
+  // We switch to it once the first frame is ready
   _scene->loadCutscene(fileName);
-  _state->set(StateCutscene);
+  _isCutscenePending = true;
   cursorManager.fadeOut();
 }
 
@@ -222,6 +224,10 @@ void Control::lookAt(float horizontal, float vertical, bool instant, bool adjust
   }
 }
 
+void Control::prepareCutscene(const char* fileName) {
+  _scene->loadCutscene(fileName);
+}
+
 void Control::processFunctionKey(int aKey) {
   int idx = 0;
   
@@ -829,16 +835,21 @@ void Control::switchTo(Object* theTarget) {
             
             if (video->isLoaded()) {
               if (!spot->hasTexture()) {
-                Texture* texture = new Texture;
-                spot->setTexture(texture);
+                // Spots showing the same video share its texture
+                if (!video->hasTexture())
+                  video->setTexture(new Texture);
+                spot->setTexture(video->texture());
               }
               
-              video->play();
-              
-              DGFrame* frame = video->currentFrame();
-              spot->texture()->loadRawData(frame->data, frame->width, frame->height);
-              
-              video->pause();
+              // Another spot may be showing it already
+              if (!video->isPlaying()) {
+                video->play();
+                
+                DGFrame* frame = video->currentFrame();
+                spot->texture()->loadFrameData(frame->data, frame->width, frame->height, frame->depth);
+                
+                video->pause();
+              }
             }
           }
           
@@ -971,6 +982,17 @@ void Control::terminate() {
 }
 
 void Control::update() {
+  if (_isCutscenePending && _scene->isCutsceneReady()) {
+    _isCutscenePending = false;
+    if (_scene->playCutscene()) {
+      _state->set(StateCutscene);
+    } else {
+      _scene->unloadCutscene();
+      cursorManager.fadeIn();
+      script.resume();
+    }
+  }
+  
   switch (_state->current()) {
     case StateLookAt:
       cameraManager.panToTargetAngle();
@@ -1019,6 +1041,10 @@ void Control::update() {
 ////////////////////////////////////////////////////////////
 
 void Control::_processAction() {
+  // The script is waiting on a cutscene that hasn't started yet
+  if (_isCutscenePending)
+    return;
+  
   Action* action = cursorManager.action();
   
   switch (action->type) {
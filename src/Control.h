@@ -115,6 +115,7 @@ class Control {
   
   bool _cancelSplash;
   bool _directControlActive;
+  bool _isCutscenePending; // Waiting for its first frame
   bool _isInitialized;
   bool _isRunning;
   bool _isShowingSplash; // Move this to state manager
@@ -143,6 +144,7 @@ public:
   bool isConsoleActive();
   bool isDirectControlActive();
   void lookAt(float horizontal, float vertical, bool instant, bool adjustment);
+  void prepareCutscene(const char* fileName);
   void processFunctionKey(int aKey);
   void processKey(int aKey, int eventFlags);
   void processMouse(int x, int y, int eventFlags);
@@ -63,10 +63,6 @@ Action* CursorManager::action() {
   return &_pointerToAction;
 }
 
-void CursorManager::bindImage() {
-  (*_current).image->bind();
-}
-
 float* CursorManager::arrayOfCoords() {
   return _arrayOfCoords;
 }
@@ -79,6 +75,10 @@ bool CursorManager::hasImage() {
   return _hasImage;
 }
 
+Texture* CursorManager::image() {
+  return (*_current).image;
+}
+
 bool CursorManager::isDragging() {
   return _isDragging;
 }
@@ -89,6 +89,7 @@ void CursorManager::load(int typeOfCursor, const char* imageFromFile, int offset
   
   texture = new Texture;
   texture->setResource(config.path(kPathResources, imageFromFile, kObjectCursor).c_str());
+  texture->setPackable(true);
   texture->load();
   
   _arrayOfCursors.push_back(_makeCursorData(typeOfCursor, texture,
@@ -76,10 +76,10 @@ public:
   }
   
   Action* action();
-  void bindImage();
   float* arrayOfCoords();
   bool hasAction();
   bool hasImage();
+  Texture* image();
   bool isDragging();
   void load(int typeOfCursor, const char* imageFromFile, int offsetX = 0, int offsetY = 0);
   bool onButton();
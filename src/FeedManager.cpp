@@ -34,6 +34,7 @@ fontManager(FontManager::instance()),
 timerManager(TimerManager::instance())
 {
   _feedHeight = kDefFeedSize;
+  _hasPrefetched = false;
 }
 
 ////////////////////////////////////////////////////////////
@@ -57,13 +58,24 @@ void FeedManager::cancel() {
 
 void FeedManager::clear() {
   _arrayOfFeeds.clear();
+  
+  if (_hasPrefetched) {
+    _nextFeedAudio->unload();
+    _hasPrefetched = false;
+  }
 }
 
 void FeedManager::init() {
   _feedAudio = new Audio;
+  _feedAudio->setPriority(kAudioPriorityFeed);
   _feedAudio->setStatic();
   audioManager.registerAudio(_feedAudio);
   
+  _nextFeedAudio = new Audio;
+  _nextFeedAudio->setPriority(kAudioPriorityFeed);
+  _nextFeedAudio->setStatic();
+  audioManager.registerAudio(_nextFeedAudio);
+  
   _feedFont = fontManager.loadDefault();
 }
 
@@ -86,6 +98,7 @@ void FeedManager::queue(const char* text, const char* audio) {
     strncpy(feed.audio, audio, kMaxFileLength);
     
     _arrayOfFeeds.push_back(feed);
+    _prefetch();
   }
 }
 
@@ -105,6 +118,18 @@ void FeedManager::reshape() {
 void FeedManager::setFont(const char* fromFileName, unsigned int heightOfFont) {
   _feedFont = fontManager.load(fromFileName, heightOfFont);
   _feedHeight = heightOfFont;
+  
+  // Active feeds must be laid out again with the new font
+  std::vector<DGFeed>::iterator it;
+  
+  it = _arrayOfActiveFeeds.begin();
+  
+  while (it != _arrayOfActiveFeeds.end() && !_arrayOfActiveFeeds.empty()) {
+    _layout(&(*it));
+    _calculatePosition(&(*it));
+    
+    ++it;
+  }
 }
 
 void FeedManager::show(const char* text) {
@@ -123,6 +148,7 @@ void FeedManager::show(const char* text) {
       DGFeed feed;
       
       strncpy(feed.text, substr.c_str(), kMaxFeedLength);
+      _layout(&feed);
       _calculatePosition(&feed);
       feed.color = kColorWhite - 0xFF000000;
       feed.state = DGFeedFadeIn;
@@ -190,13 +216,12 @@ void FeedManager::update() {
       
       // Shadow code
       if (DGFeedShadowEnabled) {
-        _feedFont->setColor(kColorBlack & (*it).color);
-        _feedFont->wPrint((*it).location.x + DGFeedShadowDistance,
-                         (*it).location.y + displace + DGFeedShadowDistance, (*it).text);
+        _feedFont->setLayoutColor(&(*it).layout, 0, kColorBlack & (*it).color);
+        _feedFont->setLayoutColor(&(*it).layout, 1, (*it).color);
       }
+      else _feedFont->setLayoutColor(&(*it).layout, 0, (*it).color);
       
-      _feedFont->setColor((*it).color);
-      _feedFont->wPrint((*it).location.x, (*it).location.y + displace, (*it).text);
+      _feedFont->drawLayout(&(*it).layout, (*it).location.x, (*it).location.y + displace);
     }
     
     ++it;
@@ -207,8 +232,23 @@ void FeedManager::update() {
     if (!_arrayOfFeeds.empty()) {
       DGFeed feed = _arrayOfFeeds.front();
       
-      this->showAndPlay(feed.text, feed.audio);
+      if (_hasPrefetched) {
+        // The next line is already loaded and decoded ahead, and it keeps
+        // those blocks when it gets its voice, so we just swap the audios
+        Audio* previous = _feedAudio;
+        _feedAudio = _nextFeedAudio;
+        _nextFeedAudio = previous;
+        _nextFeedAudio->unload();
+        _hasPrefetched = false;
+        
+        this->show(feed.text);
+        audioManager.requestAudio(_feedAudio);
+        _feedAudio->play();
+      }
+      else this->showAndPlay(feed.text, feed.audio);
+      
       _arrayOfFeeds.erase(_arrayOfFeeds.begin());
+      _prefetch();
     }
   }
   
@@ -220,9 +260,8 @@ void FeedManager::update() {
 ////////////////////////////////////////////////////////////
 
 void FeedManager::_calculatePosition(DGFeed* feed) {
-  // We have no option but to estimate this
-  int width = static_cast<int>(_feedHeight * 0.66f);
-  int length = static_cast<int>(strlen(feed->text) * width);
+  // The width is measured from the glyphs when the feed is laid out
+  int length = feed->layout.width;
   feed->location = MakePoint((config.displayWidth >> 1) - (length / 2),
                              config.displayHeight - _feedHeight - DGFeedMargin);
 }
@@ -239,6 +278,24 @@ void FeedManager::_dim() {
   }
 }
 
+void FeedManager::_prefetch() {
+  if (!_hasPrefetched && !_arrayOfFeeds.empty() && !config.silentFeeds) {
+    if (_nextFeedAudio->isLoaded())
+      _nextFeedAudio->unload();
+    
+    // Loading starts decoding ahead from the beginning, which is where
+    // play() resumes, so the line starts without waiting on the decoders
+    _nextFeedAudio->setResource(_arrayOfFeeds.front().audio);
+    _nextFeedAudio->load();
+    _hasPrefetched = true;
+  }
+}
+
+void FeedManager::_layout(DGFeed* feed) {
+  _feedFont->makeLayout(feed->text, &feed->layout,
+                        DGFeedShadowEnabled ? DGFeedShadowDistance : 0);
+}
+
 void FeedManager::_flush() {
   bool done = false;
   
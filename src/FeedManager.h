@@ -18,6 +18,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include "Font.h"
 #include "Platform.h"
 
 ////////////////////////////////////////////////////////////
@@ -49,6 +50,7 @@ typedef struct {
   char text[kMaxFeedLength];
   char audio[kMaxFileLength];
   int timerHandle;
+  TextLayout layout; // Built once when the feed is shown
 } DGFeed;
 
 class Audio;
@@ -69,6 +71,8 @@ class FeedManager {
   TimerManager& timerManager;
   
   Audio* _feedAudio;
+  Audio* _nextFeedAudio; // Next queued line, loaded while the current one plays
+  bool _hasPrefetched;
   std::vector<DGFeed> _arrayOfActiveFeeds;
   std::vector<DGFeed> _arrayOfFeeds;
   Font* _feedFont;
@@ -76,7 +80,9 @@ class FeedManager {
   
   void _calculatePosition(DGFeed* feed);
   void _dim();
+  void _layout(DGFeed* feed);
   void _flush();
+  void _prefetch();
   
   FeedManager();
   FeedManager(FeedManager const&);
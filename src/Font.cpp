@@ -15,8 +15,11 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <cmath>
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
@@ -35,7 +38,15 @@ Font::Font() :
 config(Config::instance()),
 log(Log::instance())
 {
+  _atlas = 0;
+  _face = NULL;
+  _height = 0;
+  _isAtlasFull = false;
+  _isDistanceField = false;
   _isLoaded = false;
+  _program = 0;
+  _source = NULL;
+  _resetPacker(kFontAtlasMinSize);
   this->setType(kObjectFont);
 }
 
@@ -44,86 +55,134 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 void Font::clear() {
-  if (_isLoaded)
-    glDeleteTextures(kMaxChars, _textures);
+  if (_isLoaded) {
+    glDeleteTextures(1, &_atlas);
+    FT_Done_Face(_face);
+    _atlasData.clear();
+    _extendedGlyphs.clear();
+    _isLoaded = false;
+  }
+}
+
+void Font::drawLayout(TextLayout* layout, int x, int y) {
+  if (!this->isLoaded() || layout->vertices.empty())
+    return;
+  
+  Font* source = _source ? _source : this;
+  
+  // The atlas only grows by doubling, so this is exact
+  if (layout->atlasWidth != source->_atlasWidth) {
+    GLfloat factor = static_cast<GLfloat>(layout->atlasWidth) /
+      source->_atlasWidth;
+    for (size_t i = 0; i < layout->texCoords.size(); i++)
+      layout->texCoords[i] *= factor;
+    layout->atlasWidth = source->_atlasWidth;
+  }
+  
+  GLint program = 0;
+  if (source->_isDistanceField) {
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    glUseProgram(source->_program);
+  }
+  
+  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glPushMatrix();
+  glTranslatef(static_cast<GLfloat>(x), static_cast<GLfloat>(y), 0);
+  glBindTexture(GL_TEXTURE_2D, source->_atlas);
+  
+  // Without colors, the text is drawn with the current one
+  if (!layout->colors.empty()) {
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, &layout->colors[0]);
+  }
+  
+  glTexCoordPointer(2, GL_FLOAT, 0, &layout->texCoords[0]);
+  glVertexPointer(2, GL_FLOAT, 0, &layout->vertices[0]);
+  glDrawArrays(GL_TRIANGLES, 0,
+               static_cast<GLsizei>(layout->vertices.size() >> 1));
+  
+  if (!layout->colors.empty())
+    glDisableClientState(GL_COLOR_ARRAY);
+  
+  glPopMatrix();
+  glPopAttrib();
+  
+  if (source->_isDistanceField)
+    glUseProgram(program);
 }
 
 bool Font::isLoaded() {
+  if (_source)
+    return _source->isLoaded();
+  
   return _isLoaded;
 }
 
+void Font::makeLayout(const char* text, TextLayout* layout,
+                      int shadowDistance) {
+  wchar_t wcstring[kMaxFeedLength];
+  size_t length = mbstowcs(wcstring, text, kMaxFeedLength);
+  
+  if (length == static_cast<size_t>(-1))
+    length = 0;
+  
+  _layout(wcstring, length, layout, shadowDistance);
+  layout->colors.assign(2 * layout->vertices.size(), 0xFF);
+}
+
+// Rasterizes the given characters in advance, so that they are ready by the
+// time they are printed
+void Font::preload(const char* characters) {
+  if (_source) {
+    _source->preload(characters);
+  }
+  else if (_isLoaded) {
+    wchar_t wcstring[kMaxFeedLength];
+    size_t length = mbstowcs(wcstring, characters, kMaxFeedLength);
+    
+    if (length == static_cast<size_t>(-1))
+      return;
+    
+    for (size_t i = 0; i < length; i++)
+      _glyphFor(wcstring[i]);
+  }
+}
+
 void Font::print(int x, int y, const char* text, ...) {
-  if (_isLoaded) {
+  if (this->isLoaded()) {
     char buffer[kMaxFeedLength];
+    wchar_t wcstring[kMaxFeedLength];
     va_list ap;
     
     va_start(ap, text);
     int length = vsnprintf(buffer, kMaxFeedLength, text, ap);
     va_end(ap);
     
-    glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TRANSFORM_BIT);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glPushMatrix();
-    glTranslatef(x, y, 0);
+    if (length >= kMaxFeedLength)
+      length = kMaxFeedLength - 1;
     
-    for (const char* c = buffer; length > 0; c++, length--) {
-      int ch = *c;
-      
-      GLfloat texCoords[] = { 0, 0, 0, _glyph[ch].y,
-        _glyph[ch].x, _glyph[ch].y, _glyph[ch].x, 0 };
-      
-      GLshort coords[] = { 0, 0, 0, _glyph[ch].rows,
-        _glyph[ch].width, _glyph[ch].rows, _glyph[ch].width, 0 };
-      
-      glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].left), 0, 0);
-      glPushMatrix();
-      glTranslatef(0, -static_cast<GLfloat>(_glyph[ch].top) + _height, 0);
-      glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
-      glVertexPointer(2, GL_SHORT, 0, coords);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-      glPopMatrix();
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].advance >> 6), 0, 0);
-    }
-    glPopMatrix();
-    glPopAttrib();
+    // Plain text maps directly to the first code points
+    for (int i = 0; i < length; i++)
+      wcstring[i] = static_cast<unsigned char>(buffer[i]);
+    
+    _layout(wcstring, length, &_text, 0);
+    drawLayout(&_text, x, y);
   }
 }
 
 void Font::wPrint(int x, int y, const char* text) {
-  if (_isLoaded) {
-    size_t origsize = strlen(text) + 1;
+  if (this->isLoaded()) {
     wchar_t wcstring[kMaxFeedLength];
    // setlocale(LC_CTYPE, "en_US.UTF-8");
-    mbstowcs(wcstring, text, origsize);
+    size_t length = mbstowcs(wcstring, text, kMaxFeedLength);
    // setlocale(LC_ALL,"C");
     
-    glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_TRANSFORM_BIT);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glPushMatrix();
-    glTranslatef(x, y, 0);
+    if (length == static_cast<size_t>(-1))
+      return;
     
-    size_t length = wcslen(wcstring);
-    for (const wchar_t* c = wcstring; length > 0; c++, length--) {
-      unsigned long ch = *c;
-      GLfloat texCoords[] = { 0, 0, 0, _glyph[ch].y,
-        _glyph[ch].x, _glyph[ch].y, _glyph[ch].x, 0 };
-      
-      GLshort coords[] = { 0, 0, 0, _glyph[ch].rows,
-        _glyph[ch].width, _glyph[ch].rows, _glyph[ch].width, 0 };
-      
-      glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].left), 0, 0);
-      glPushMatrix();
-      glTranslatef(0, -static_cast<GLfloat>(_glyph[ch].top) + _height, 0);
-      glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
-      glVertexPointer(2, GL_SHORT, 0, coords);
-      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-      glPopMatrix();
-      glTranslatef(static_cast<GLfloat>(_glyph[ch].advance >> 6), 0, 0);
-    }
-    glPopMatrix();
-    glPopAttrib();
+    _layout(wcstring, length, &_text, 0);
+    drawLayout(&_text, x, y);
   }
 }
 
@@ -138,6 +197,17 @@ void Font::setColor(uint32_t color) {
   glColor4f(r/255.0f, g/255.0f, b/255.0f, a/255.0f);
 }
 
+void Font::setLayoutColor(TextLayout* layout, int instance, uint32_t color) {
+  size_t count = layout->colors.size() / layout->instances;
+  GLubyte rgba[] = { static_cast<GLubyte>((color & 0x00ff0000) >> 16),
+    static_cast<GLubyte>((color & 0x0000ff00) >> 8),
+    static_cast<GLubyte>(color & 0x000000ff),
+    static_cast<GLubyte>((color & 0xff000000) >> 24) };
+  
+  for (size_t i = count * instance; i < count * (instance + 1); i += 4)
+    memcpy(&layout->colors[i], rgba, 4);
+}
+
 void Font::setDefault(unsigned int heightOfFont) {
   FT_Face face;
   
@@ -148,7 +218,12 @@ void Font::setDefault(unsigned int heightOfFont) {
   
   _height = heightOfFont;
   _loadFont(face);
-  FT_Done_Face(face);
+}
+
+// Must be set before loading the font
+void Font::setDistanceField(GLuint program) {
+  _isDistanceField = true;
+  _program = program;
 }
 
 void Font::setLibrary(FT_Library* library) {
@@ -169,78 +244,330 @@ void Font::setResource(const std::string &fromFileName,
   
   _height = heightOfFont;
   _loadFont(face);
-  FT_Done_Face(face);
+}
+
+void Font::setSource(Font* source, unsigned int heightOfFont) {
+  _height = heightOfFont;
+  _source = source;
 }
 
 ////////////////////////////////////////////////////////////
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
-void Font::_loadFont(FT_Face &face) {
-  FT_Set_Char_Size(face, _height << 6, _height << 6, 96, 96);
-  glGenTextures(kMaxChars, _textures);
+// Rasterizes a glyph and stores it in the atlas
+Glyph Font::_cacheGlyph(unsigned long ch) {
+  Glyph cached;
+  memset(&cached, 0, sizeof(cached));
+  cached.isCached = true; // Failed glyphs are cached as empty too
   
-  for (wchar_t ch = 0; ch < kMaxChars; ch++) {
-    if (FT_Load_Glyph(face, FT_Get_Char_Index(face, ch), FT_LOAD_DEFAULT)) {
-      log.error(kModFont, "%s: %c", kString15006, ch);
-      return;
+  if (FT_Load_Glyph(_face, FT_Get_Char_Index(_face, ch), FT_LOAD_DEFAULT)) {
+    log.error(kModFont, "%s: %lu", kString15006, ch);
+    return cached;
+  }
+  
+  FT_Glyph glyph;
+  if (FT_Get_Glyph(_face->glyph, &glyph)) {
+    log.error(kModFont, "%s: %lu", kString15007, ch);
+    return cached;
+  }
+  
+  FT_Glyph_To_Bitmap(&glyph, ft_render_mode_normal, 0, 1);
+  FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
+  FT_Bitmap bitmap = bitmapGlyph->bitmap;
+  cached = _makeGlyph(bitmapGlyph, _face);
+  
+  // Distance fields extend beyond the edges of the glyph
+  const GLubyte* pixels = bitmap.buffer;
+  int pitch = abs(bitmap.pitch);
+  if (_isDistanceField && cached.width > 0 && cached.rows > 0) {
+    _makeDistanceField(bitmap);
+    cached.width += 2 * kFontDistanceFieldSpread;
+    cached.rows += 2 * kFontDistanceFieldSpread;
+    cached.left -= kFontDistanceFieldSpread;
+    cached.top += kFontDistanceFieldSpread;
+    pixels = &_field[0];
+    pitch = cached.width;
+  }
+  
+  int x, y;
+  bool fits = _pack(cached.width, cached.rows, &x, &y);
+  while (!fits && _growAtlas())
+    fits = _pack(cached.width, cached.rows, &x, &y);
+  
+  if (!fits) {
+    // Keep the advance so that the layout doesn't break
+    if (!_isAtlasFull) {
+      log.error(kModFont, "%s", kString15008);
+      _isAtlasFull = true;
     }
-    
-    FT_Glyph glyph;
-    if (FT_Get_Glyph(face->glyph, &glyph)) {
-      log.error(kModFont, "%s: %c", kString15007, ch);
-      return;
+    cached.width = 0;
+    cached.rows = 0;
+    FT_Done_Glyph(glyph);
+    return cached;
+  }
+  
+  for (int j = 0; j < cached.rows; j++) {
+    for (int i = 0; i < cached.width; i++) {
+      GLubyte* pixel = &_atlasData[2 * ((x + i) + (y + j) * _atlasWidth)];
+      pixel[0] = pixel[1] = pixels[i + pitch * j];
+    }
+  }
+  
+  // Upload only the region covered by the new glyph
+  if (cached.width > 0 && cached.rows > 0) {
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, _atlasWidth);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, y);
+    glBindTexture(GL_TEXTURE_2D, _atlas);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, cached.width, cached.rows,
+                    GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, &_atlasData[0]);
+    glPopClientAttrib();
+  }
+  
+  cached.s0 = static_cast<GLfloat>(x) / _atlasWidth;
+  cached.t0 = static_cast<GLfloat>(y) / _atlasHeight;
+  cached.s1 = static_cast<GLfloat>(x + cached.width) / _atlasWidth;
+  cached.t1 = static_cast<GLfloat>(y + cached.rows) / _atlasHeight;
+  
+  FT_Done_Glyph(glyph);
+  return cached;
+}
+
+// Builds the quads for the whole string so that it can be drawn in a single
+// call, relative to the origin
+void Font::_layout(const wchar_t* text, size_t length, TextLayout* layout,
+                   int shadowDistance) {
+  layout->vertices.clear();
+  layout->texCoords.clear();
+  layout->colors.clear();
+  layout->instances = (shadowDistance > 0) ? 2 : 1;
+  layout->width = 0;
+  
+  if (!this->isLoaded())
+    return;
+  
+  Font* source = _source ? _source : this;
+  GLfloat scale = static_cast<GLfloat>(_height) / source->_height;
+  GLfloat pen = 0.0f;
+  GLfloat baseline = static_cast<GLfloat>(_height);
+  
+  // Cache every glyph first, as the atlas may grow and move the texture
+  // coordinates of the ones already taken
+  for (size_t i = 0; i < length; i++)
+    source->_glyphFor(text[i]);
+  
+  for (size_t i = 0; i < length; i++) {
+    const Glyph& glyph = source->_glyphFor(text[i]);
+    if (glyph.width > 0 && glyph.rows > 0) {
+      GLfloat x0 = pen + glyph.left * scale;
+      GLfloat y0 = baseline - glyph.top * scale;
+      GLfloat x1 = x0 + glyph.width * scale;
+      GLfloat y1 = y0 + glyph.rows * scale;
+      
+      // Two triangles per glyph
+      GLfloat coords[] = { x0, y0, x0, y1, x1, y1,
+        x0, y0, x1, y1, x1, y0 };
+      GLfloat texCoords[] = { glyph.s0, glyph.t0, glyph.s0, glyph.t1,
+        glyph.s1, glyph.t1, glyph.s0, glyph.t0, glyph.s1, glyph.t1,
+        glyph.s1, glyph.t0 };
+      
+      layout->vertices.insert(layout->vertices.end(), coords, coords + 12);
+      layout->texCoords.insert(layout->texCoords.end(), texCoords,
+                               texCoords + 12);
     }
     
-    FT_Glyph_To_Bitmap(&glyph, ft_render_mode_normal, 0, 1);
-    FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
-    FT_Bitmap bitmap = bitmapGlyph->bitmap;
-    
-    int width = _next(bitmap.width);
-    int height = _next(bitmap.rows);
-    GLubyte* expandedData;
-    expandedData = new GLubyte[2 * width * height];
+    pen += (glyph.advance >> 6) * scale;
+  }
+  
+  // The shadow is drawn first, so it goes before the text
+  if (shadowDistance > 0) {
+    std::vector<GLfloat> vertices(layout->vertices);
+    std::vector<GLfloat> texCoords(layout->texCoords);
     
-    for (int j = 0; j < height; j++) {
-      for (int i = 0; i < width; i++) {
-        expandedData[2 * (i + j * width)] =
-        expandedData[2 * (i + j * width) + 1] =
-        (i >= bitmap.width || j >= bitmap.rows) ?
-        0 : bitmap.buffer[i + bitmap.width * j];
-      }
-    }
+    for (size_t i = 0; i < layout->vertices.size(); i++)
+      layout->vertices[i] += shadowDistance;
     
-    float x = static_cast<float>(bitmap.width) / static_cast<float>(width);
-    float y = static_cast<float>(bitmap.rows) / static_cast<float>(height);
-    _glyph[ch] = _makeGlyph(x, y, bitmap, bitmapGlyph, face);
+    layout->vertices.insert(layout->vertices.end(), vertices.begin(),
+                            vertices.end());
+    layout->texCoords.insert(layout->texCoords.end(), texCoords.begin(),
+                             texCoords.end());
+  }
+  
+  layout->atlasWidth = source->_atlasWidth;
+  layout->width = static_cast<int>(pen + 0.5f);
+}
+
+const Glyph& Font::_glyphFor(unsigned long ch) {
+  if (ch < static_cast<unsigned long>(kMaxChars)) {
+    if (!_glyph[ch].isCached)
+      _glyph[ch] = _cacheGlyph(ch);
     
-    glBindTexture(GL_TEXTURE_2D, _textures[ch]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, 2, width, height, 0,
-                 GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, expandedData);
-    delete[] expandedData;
+    return _glyph[ch];
+  }
+  
+  std::map<unsigned long, Glyph>::iterator it = _extendedGlyphs.find(ch);
+  if (it == _extendedGlyphs.end())
+    it = _extendedGlyphs.insert(std::make_pair(ch, _cacheGlyph(ch))).first;
+  
+  return it->second;
+}
+
+// Doubles the size of the atlas, keeping the glyphs where they are
+bool Font::_growAtlas() {
+  if (_atlasWidth >= kFontAtlasMaxSize)
+    return false;
+  
+  int width = _atlasWidth << 1;
+  int height = _atlasHeight << 1;
+  std::vector<GLubyte> data(2 * width * height, 0);
+  
+  for (int j = 0; j < _atlasHeight; j++) {
+    memcpy(&data[2 * j * width], &_atlasData[2 * j * _atlasWidth],
+           2 * _atlasWidth);
   }
+  
+  _atlasData.swap(data);
+  _atlasWidth = width;
+  _atlasHeight = height;
+  
+  glBindTexture(GL_TEXTURE_2D, _atlas);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, _atlasWidth,
+               _atlasHeight, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+               &_atlasData[0]);
+  
+  // Texture coordinates are normalized, so they shrink by half
+  for (wchar_t ch = 0; ch < kMaxChars; ch++) {
+    _glyph[ch].s0 *= 0.5f;
+    _glyph[ch].t0 *= 0.5f;
+    _glyph[ch].s1 *= 0.5f;
+    _glyph[ch].t1 *= 0.5f;
+  }
+  
+  std::map<unsigned long, Glyph>::iterator it;
+  for (it = _extendedGlyphs.begin(); it != _extendedGlyphs.end(); ++it) {
+    it->second.s0 *= 0.5f;
+    it->second.t0 *= 0.5f;
+    it->second.s1 *= 0.5f;
+    it->second.t1 *= 0.5f;
+  }
+  
+  return true;
+}
+
+// Glyphs are no longer rasterized here, we just prepare an empty atlas
+void Font::_loadFont(FT_Face &face) {
+  _face = face;
+  FT_Set_Char_Size(_face, _height << 6, _height << 6, 96, 96);
+  
+  memset(_glyph, 0, sizeof(_glyph));
+  _extendedGlyphs.clear();
+  _isAtlasFull = false;
+  _resetPacker(kFontAtlasMinSize);
+  _atlasData.assign(2 * _atlasWidth * _atlasHeight, 0);
+  
+  glGenTextures(1, &_atlas);
+  glBindTexture(GL_TEXTURE_2D, _atlas);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, _atlasWidth,
+               _atlasHeight, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+               &_atlasData[0]);
+  
   _isLoaded = true;
 }
   
-Glyph Font::_makeGlyph(float x, float y, FT_Bitmap bitmap,
-                       FT_BitmapGlyph bitmapGlyph, FT_Face face) {
+// Brute force search of the nearest edge within the spread. This is only done
+// once per glyph and face, so there's no need for anything smarter.
+void Font::_makeDistanceField(const FT_Bitmap &bitmap) {
+  const int spread = kFontDistanceFieldSpread;
+  int width = bitmap.width + 2 * spread;
+  int height = bitmap.rows + 2 * spread;
+  int pitch = abs(bitmap.pitch);
+  
+  // Coverage of the glyph with the spread as a blank margin
+  std::vector<bool> inside(width * height, false);
+  for (int j = 0; j < bitmap.rows; j++) {
+    for (int i = 0; i < bitmap.width; i++) {
+      inside[(i + spread) + (j + spread) * width] =
+        (bitmap.buffer[i + pitch * j] >= 128);
+    }
+  }
+  
+  _field.resize(width * height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      bool isInside = inside[x + y * width];
+      int nearest = (spread * spread) + 1;
+      
+      for (int dy = -spread; dy <= spread; dy++) {
+        for (int dx = -spread; dx <= spread; dx++) {
+          int nx = x + dx;
+          int ny = y + dy;
+          bool other = (nx >= 0 && ny >= 0 && nx < width && ny < height) ?
+            inside[nx + ny * width] : false;
+          
+          if (other != isInside && (dx * dx + dy * dy) < nearest)
+            nearest = dx * dx + dy * dy;
+        }
+      }
+      
+      float distance = sqrtf(static_cast<float>(nearest));
+      if (distance > spread)
+        distance = static_cast<float>(spread);
+      if (!isInside)
+        distance = -distance;
+      
+      // Edges end up at half intensity
+      _field[x + y * width] =
+        static_cast<GLubyte>((0.5f + (distance / (2 * spread))) * 255.0f);
+    }
+  }
+}
+
+Glyph Font::_makeGlyph(FT_BitmapGlyph bitmapGlyph, FT_Face face) {
   Glyph glyph;
-  glyph.x = x;
-  glyph.y = y;
-  glyph.width = bitmap.width;
-  glyph.rows = bitmap.rows;
+  glyph.s0 = glyph.t0 = glyph.s1 = glyph.t1 = 0.0f;
+  glyph.width = bitmapGlyph->bitmap.width;
+  glyph.rows = bitmapGlyph->bitmap.rows;
   glyph.left = bitmapGlyph->left;
   glyph.top = bitmapGlyph->top;
   glyph.advance = face->glyph->advance.x;
+  glyph.isCached = true;
   return glyph;
 }
+// Simple shelf packing: glyphs are laid out in rows as tall as the tallest
+// glyph in them, which works well since all have a similar height.
+bool Font::_pack(int width, int height, int* x, int* y) {
+  if (_shelfX + width + kFontAtlasPadding > _atlasWidth) {
+    _shelfX = 0;
+    _shelfY += _shelfHeight + kFontAtlasPadding;
+    _shelfHeight = 0;
+  }
+  
+  if ((_shelfX + width + kFontAtlasPadding > _atlasWidth) ||
+      (_shelfY + height + kFontAtlasPadding > _atlasHeight))
+    return false;
   
-int Font::_next(int a) {
-  int rval = 1;
-  while (rval < a) rval <<= 1;
-  return rval;
+  *x = _shelfX + kFontAtlasPadding;
+  *y = _shelfY + kFontAtlasPadding;
+  _shelfX += width + kFontAtlasPadding;
+  if (height > _shelfHeight)
+    _shelfHeight = height;
+  
+  return true;
+}
+
+void Font::_resetPacker(int size) {
+  _atlasWidth = size;
+  _atlasHeight = size;
+  _shelfHeight = 0;
+  _shelfX = 0;
+  _shelfY = 0;
 }
   
 }
@@ -18,8 +18,10 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <map>
 #include <string>
 #include <stdint.h>
+#include <vector>
 #include <wchar.h>
 
 #include <ft2build.h>
@@ -42,24 +44,54 @@ class Log;
 // Definitions
 ////////////////////////////////////////////////////////////
 
+// Glyphs below this code point are looked up directly, the rest through a map
 const wchar_t kMaxChars = 256;
 
+// Glyphs are packed into a single texture per font and size, which grows
+// as new glyphs are rasterized
+const int kFontAtlasMinSize = 256;
+const int kFontAtlasMaxSize = 2048;
+const int kFontAtlasPadding = 1; // Avoids bleeding with linear filtering
+
+// Distance field fonts are rasterized once at this size and scaled with a
+// shader. The spread is the distance in pixels covered by the field.
+const unsigned int kFontDistanceFieldSize = 32;
+const int kFontDistanceFieldSpread = 4;
+
 // This structure holds information from the Freetype font
 typedef struct {
-  float x;
-  float y;
+  GLfloat s0; // Texture coordinates of the glyph within the atlas
+  GLfloat t0;
+  GLfloat s1;
+  GLfloat t1;
   GLshort width;
   GLshort rows;
   int left;
   int top;
   long advance;
+  bool isCached;
 } Glyph;
 
+// A string laid out in advance so that it can be drawn repeatedly. It may
+// hold several copies of the text (eg: a shadow first, then the text), each
+// one with its own color.
+typedef struct {
+  std::vector<GLubyte> colors;
+  std::vector<GLfloat> texCoords;
+  std::vector<GLfloat> vertices;
+  int atlasWidth; // Coordinates must be rescaled if the atlas grows
+  int instances;
+  int width;
+} TextLayout;
+
 // When default font is selected, we use data embedded in the
 // executable and declared in FontData.cpp
 extern "C" const unsigned char kFontData[];
 extern "C" const long kSizeOfFontData;
 
+// Shader for distance field fonts, declared in ShaderData.c
+extern "C" const char kFontShaderData[];
+
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
@@ -70,28 +102,65 @@ class Font : public Object {
   ~Font() {};
   
   void clear();
+  void drawLayout(TextLayout* layout, int x, int y);
   bool isLoaded();
+  void makeLayout(const char* text, TextLayout* layout,
+                  int shadowDistance = 0);
+  void preload(const char* characters);
   void print(int x, int y, const char* text, ...);
   void wPrint(int x, int y, const char* text);
   void setColor(uint32_t color);
+  void setLayoutColor(TextLayout* layout, int instance, uint32_t color);
   void setDefault(unsigned int heightOfFont);
+  void setDistanceField(GLuint program);
   void setLibrary(FT_Library* library);
   void setResource(const std::string &fromFileName, unsigned int heightOfFont);
+  void setSource(Font* source, unsigned int heightOfFont);
   
  private:
   Config& config;
   Log& log;
   
+  // Glyphs are rasterized the first time they are used
   Glyph _glyph[kMaxChars];
+  std::map<unsigned long, Glyph> _extendedGlyphs;
+  FT_Face _face;
   unsigned int _height;
+  bool _isAtlasFull;
+  bool _isDistanceField;
   bool _isLoaded;
   FT_Library* _library;
-  GLuint _textures[kMaxChars];
+  GLuint _program;
+  
+  // Fonts with a source draw through its distance field at their own size
+  Font* _source;
+  
+  // The atlas holding every cached glyph of this font, along with a copy in
+  // system memory so that it can be grown
+  GLuint _atlas;
+  std::vector<GLubyte> _atlasData;
+  int _atlasHeight;
+  int _atlasWidth;
+  
+  // Shelf packer state for the atlas
+  int _shelfHeight;
+  int _shelfX;
+  int _shelfY;
+  
+  // Reused between calls to avoid allocations when drawing text
+  std::vector<GLubyte> _field;
+  TextLayout _text;
   
+  Glyph _cacheGlyph(unsigned long ch);
+  void _layout(const wchar_t* text, size_t length, TextLayout* layout,
+               int shadowDistance);
+  const Glyph& _glyphFor(unsigned long ch);
+  bool _growAtlas();
   void _loadFont(FT_Face &face);
-  Glyph _makeGlyph(float x, float y, FT_Bitmap bitmap,
-                   FT_BitmapGlyph bitmapGlyph, FT_Face face);
-  int _next(int a);
+  void _makeDistanceField(const FT_Bitmap &bitmap);
+  Glyph _makeGlyph(FT_BitmapGlyph bitmapGlyph, FT_Face face);
+  bool _pack(int width, int height, int* x, int* y);
+  void _resetPacker(int size);
   
   Font(const Font&);
   void operator=(const Font&);
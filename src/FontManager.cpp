@@ -15,6 +15,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include "Config.h"
 #include "FontManager.h"
 #include "Log.h"
 
@@ -25,8 +26,11 @@ namespace dagon {
 ////////////////////////////////////////////////////////////
 
 FontManager::FontManager() :
+config(Config::instance()),
 log(Log::instance())
 {
+  _distanceFieldProgram = 0;
+  _isDistanceFieldReady = false;
   _isInitialized = false;
 }
 
@@ -64,12 +68,25 @@ void FontManager::init(){
 }
 
 Font* FontManager::load(const char* fromFileName, unsigned int heightOfFont){
+  char key[kMaxFileLength];
+  snprintf(key, kMaxFileLength, "%s:%u", fromFileName, heightOfFont);
+  
+  std::map<std::string, Font*>::iterator it = _mapOfFonts.find(key);
+  if (it != _mapOfFonts.end())
+    return it->second;
+  
   Font* font = new Font;
   
-  font->setLibrary(&_library);
-  font->setResource(fromFileName, heightOfFont);
+  if (config.distanceFieldFonts && _initDistanceField()) {
+    font->setSource(_loadFace(fromFileName), heightOfFont);
+  }
+  else {
+    font->setLibrary(&_library);
+    font->setResource(fromFileName, heightOfFont);
+    font->preload(kFontCharset);
+  }
   
-  _arrayOfFonts.push_back(font);
+  _mapOfFonts[key] = font;
   
   return font;
 }
@@ -78,9 +95,66 @@ Font* FontManager::loadDefault() {
   if (!_defaultFont.isLoaded()) {
     _defaultFont.setLibrary(&_library);
     _defaultFont.setDefault(kDefFontSize);
+    _defaultFont.preload(kFontCharset);
   }
   
   return &_defaultFont;
 }
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+bool FontManager::_initDistanceField() {
+  if (!_isDistanceFieldReady && _distanceFieldProgram == 0) {
+    if (!glewIsSupported("GL_VERSION_2_0")) {
+      log.warning(kModFont, "%s", kString15009);
+      config.distanceFieldFonts = false;
+      return false;
+    }
+    
+    const char* pointerToData = kFontShaderData;
+    GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &pointerToData, NULL);
+    glCompileShader(fragment);
+    
+    _distanceFieldProgram = glCreateProgram();
+    glAttachShader(_distanceFieldProgram, fragment);
+    glLinkProgram(_distanceFieldProgram);
+    
+    // Flagged for deletion along with the program
+    glDeleteShader(fragment);
+    
+    GLint status;
+    glGetProgramiv(_distanceFieldProgram, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+      log.warning(kModFont, "%s", kString15009);
+      config.distanceFieldFonts = false;
+      return false;
+    }
+    
+    _isDistanceFieldReady = true;
+  }
+  
+  return _isDistanceFieldReady;
+}
+
+// Distance field faces are rasterized only once and shared by all sizes
+Font* FontManager::_loadFace(const char* fromFileName) {
+  std::map<std::string, Font*>::iterator it = _mapOfFaces.find(fromFileName);
+  if (it != _mapOfFaces.end())
+    return it->second;
+  
+  Font* face = new Font;
+  
+  face->setLibrary(&_library);
+  face->setDistanceField(_distanceFieldProgram);
+  face->setResource(fromFileName, kFontDistanceFieldSize);
+  face->preload(kFontCharset);
+  
+  _mapOfFaces[fromFileName] = face;
+  
+  return face;
+}
   
 }
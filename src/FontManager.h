@@ -18,6 +18,9 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <map>
+#include <string>
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
@@ -33,6 +36,7 @@
 
 namespace dagon {
 
+class Config;
 class Font;
 class Log;
 
@@ -41,14 +45,22 @@ class Log;
 ////////////////////////////////////////////////////////////
 
 class FontManager {
+  Config& config;
   Log& log;
   
-  std::vector<Font*> _arrayOfFonts;
+  // Fonts are shared by file and height, distance field faces by file only
+  std::map<std::string, Font*> _mapOfFaces;
+  std::map<std::string, Font*> _mapOfFonts;
   
   Font _defaultFont;
+  GLuint _distanceFieldProgram;
+  bool _isDistanceFieldReady;
   bool _isInitialized;
   FT_Library _library;
   
+  bool _initDistanceField();
+  Font* _loadFace(const char* fromFileName);
+  
   FontManager();
   FontManager(FontManager const&);
   FontManager& operator=(FontManager const&);
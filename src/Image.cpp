@@ -36,6 +36,7 @@ config(Config::instance())
 Image::Image(const std::string &fromFileName) :
 config(Config::instance())
 {
+  _hasTexture = false;
   this->setTexture(fromFileName);
   if (_attachedTexture->isLoaded()) {
     _rect.origin = ZeroPoint;
@@ -46,6 +47,16 @@ config(Config::instance())
   this->setType(kObjectImage);
 }
 
+////////////////////////////////////////////////////////////
+// Implementation - Destructor
+////////////////////////////////////////////////////////////
+
+Image::~Image() {
+  // Also gives back its region of the atlas page, if packed
+  if (_hasTexture)
+    delete _attachedTexture;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Checks
 ////////////////////////////////////////////////////////////
@@ -94,9 +105,12 @@ void Image::setTexture(const std::string &fromFileName) {
   // resource manager.
   // FIXME: These textures are immediately loaded which isn't very efficient.
   
+  if (_hasTexture)
+    delete _attachedTexture;
   _attachedTexture = new Texture;
   _attachedTexture->setResource(config.path(kPathResources, fromFileName,
                                             kObjectImage).c_str());
+  _attachedTexture->setPackable(true);
   _attachedTexture->load();
   _hasTexture = true;
 }
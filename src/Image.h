@@ -40,7 +40,7 @@ class Image : public Object {
  public:
   Image();
   Image(const std::string &fromFileName);
-  ~Image() {};
+  ~Image();
   
   // Checks
   bool hasTexture();
@@ -63,9 +63,10 @@ void Interface::drawCursor() {
   if (cursorManager.isEnabled()) {
     if (cursorManager.hasImage()) { // A bitmap cursor is currently set
       cursorManager.updateFade(); // Process fade (supported only with bitmaps)
-      cursorManager.bindImage();
-      renderManager.setAlpha(cursorManager.fadeLevel());
-      renderManager.drawSlide(cursorManager.arrayOfCoords());
+      renderManager.drawSprite(cursorManager.image(),
+                               cursorManager.arrayOfCoords(),
+                               cursorManager.fadeLevel());
+      renderManager.flushSprites();
     }
     else {
       Point position = cursorManager.position();
@@ -118,12 +119,14 @@ void Interface::drawOverlays() {
               button->updateFade();
               
               if (button->hasTexture()) {
-                renderManager.setAlpha(button->fadeLevel());
-                button->texture()->bind();
-                renderManager.drawSlide(button->arrayOfCoordinates());
+                renderManager.drawSprite(button->texture(),
+                                         button->arrayOfCoordinates(),
+                                         button->fadeLevel());
               }
               
               if (button->hasText()) {
+                // Text goes on top of the button
+                renderManager.flushSprites();
                 Point position = button->position();
                 // int color = button->textColor();
                 if (button->isFading())
@@ -147,9 +150,9 @@ void Interface::drawOverlays() {
             Image* image = (*itOverlay)->currentImage();
             if (image->isEnabled()) {
               image->updateFade(); // Perform any necessary updates
-              image->texture()->bind();
-              renderManager.setAlpha(image->fadeLevel());
-              renderManager.drawSlide(image->arrayOfCoordinates());
+              renderManager.drawSprite(image->texture(),
+                                       image->arrayOfCoordinates(),
+                                       image->fadeLevel());
             }
           } while ((*itOverlay)->iterateImages());
         }
@@ -158,6 +161,8 @@ void Interface::drawOverlays() {
       
       ++itOverlay;
     }
+    
+    renderManager.flushSprites();
   }
 }
 
@@ -52,6 +52,7 @@
 #define kString11004 "Could not create framebuffer"
 #define kString11005 "GLEW version"
 #define kString11006 "OpenGL error"
+#define kString11007 "Video shaders not supported on this system"
 
 // Control module
 #define kString12001 "Dagon version"
@@ -108,6 +109,11 @@
 #define kString15005 "Default font is corrupt"
 #define kString15006 "Error loading glyph"
 #define kString15007 "Error getting glyph"
+#define kString15008 "Glyphs do not fit in font atlas"
+#define kString15009 "Distance field fonts not supported on this system"
+
+// Characters rasterized in advance when loading a font
+#define kFontCharset " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"
 
 // Audio module
 #define kString16001 "Initializing audio manager..."
@@ -132,11 +138,14 @@
 #define kString17008 "Error parsing stream headers"
 #define kString17009 "End of file while searching for codec headers"
 #define kString17010 "Resource not set in video object"
+#define kString17011 "Video already follows the audio of another spot"
+#define kString17012 "SIMD video conversion differs from the reference, using the scalar one"
 
 // SDL errors
 #define kString18001 "Could not create mutex"
 #define kString18002 "Could not lock mutex"
 #define kString18003 "Failed to create thread"
+#define kString18004 "Could not create semaphore"
 
 #endif // English
 
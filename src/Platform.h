@@ -42,6 +42,25 @@
 
 #endif
 
+////////////////////////////////////////////////////////////
+// Detect SIMD support
+////////////////////////////////////////////////////////////
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+
+#define DAGON_SSE2
+
+#endif
+
+// AVX2 kernels are compiled for that instruction set on their own and only
+// picked when the CPU reports it, so this just requires a capable compiler
+#if defined(DAGON_SSE2) && (defined(__clang__) || defined(_MSC_VER) && (_MSC_VER >= 1700) || \
+    (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+
+#define DAGON_AVX2
+
+#endif
+
 ////////////////////////////////////////////////////////////
 // Include standard OpenGL headers
 ////////////////////////////////////////////////////////////
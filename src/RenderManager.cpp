@@ -39,6 +39,8 @@ log(Log::instance())
   
   _blendNextUpdate = false;
   _texturesEnabled = false;
+  _videoProgram = 0;
+  _previousProgram = 0;
 }
 
 ////////////////////////////////////////////////////////////
@@ -73,6 +75,9 @@ void RenderManager::init() {
     _effectsEnabled = false;
   }
   
+  if (config.videoShader)
+    _initVideoShader();
+  
   _alphaEnabled = true;
   
   // WARNING: This next setting could make things slower
@@ -218,6 +223,13 @@ void RenderManager::enableTextures() {
   }
 }
 
+void RenderManager::enableVideoShader() {
+  if (_videoProgram) {
+    glGetIntegerv(GL_CURRENT_PROGRAM, &_previousProgram);
+    glUseProgram(_videoProgram);
+  }
+}
+
 void RenderManager::disableAlpha() {
   _alphaEnabled = false;
   glBlendFunc(GL_ONE, GL_ZERO);
@@ -238,6 +250,11 @@ void RenderManager::disableTextures() {
   }
 }
 
+void RenderManager::disableVideoShader() {
+  if (_videoProgram)
+    glUseProgram(_previousProgram);
+}
+
 void RenderManager::drawHelper(int xPosition, int yPosition, bool animate) {
   glDisable(GL_LINE_SMOOTH);
   
@@ -441,6 +458,65 @@ void RenderManager::drawSlide(float* withArrayOfCoordinates) {
   glPopMatrix();
 }
 
+// Sprites are queued and drawn on the next flush, merging consecutive sprites
+// that share a texture or atlas page into a single call. Anything drawn in
+// between must flush first to preserve the order.
+void RenderManager::drawSprite(Texture* texture, float* withArrayOfCoordinates,
+                               float alpha) {
+  if (!texture->isLoaded())
+    return;
+  
+  const GLfloat* texCoords = texture->texCoords();
+  const GLubyte color[] = {0xFF, 0xFF, 0xFF,
+    static_cast<GLubyte>(alpha * 255.0f)};
+  
+  // The slide is a fan of four vertices, split here into two triangles
+  const int indices[] = {0, 1, 2, 0, 2, 3};
+  for (int i = 0; i < 6; i++) {
+    int index = indices[i] * 2;
+    _spriteVertices.push_back(withArrayOfCoordinates[index]);
+    _spriteVertices.push_back(withArrayOfCoordinates[index + 1]);
+    _spriteTexCoords.push_back(texCoords[index]);
+    _spriteTexCoords.push_back(texCoords[index + 1]);
+    _spriteColors.insert(_spriteColors.end(), color, color + 4);
+  }
+  
+  _spriteTextures.push_back(texture->ident());
+}
+
+void RenderManager::flushSprites() {
+  if (_spriteTextures.empty())
+    return;
+  
+  this->enableTextures();
+  
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, 0, &_spriteColors[0]);
+  glTexCoordPointer(2, GL_FLOAT, 0, &_spriteTexCoords[0]);
+  glVertexPointer(2, GL_FLOAT, 0, &_spriteVertices[0]);
+  
+  std::size_t first = 0;
+  for (std::size_t i = 1; i <= _spriteTextures.size(); i++) {
+    if (i == _spriteTextures.size() ||
+        _spriteTextures[i] != _spriteTextures[first]) {
+      glBindTexture(GL_TEXTURE_2D, _spriteTextures[first]);
+      glDrawArrays(GL_TRIANGLES, static_cast<GLint>(first * 6),
+                   static_cast<GLsizei>((i - first) * 6));
+      first = i;
+    }
+  }
+  
+  glDisableClientState(GL_COLOR_ARRAY);
+  
+  // The current color is undefined after using a color array
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+  
+  _spriteColors.clear();
+  _spriteTexCoords.clear();
+  _spriteTextures.clear();
+  _spriteVertices.clear();
+}
+
 void RenderManager::setAlpha(float alpha) {
   // NOTE: This resets the current color so it should be used with care
   glColor4f(1.0f, 1.0f, 1.0f, alpha);
@@ -689,5 +765,43 @@ void RenderManager::_initFrameBufferTexture() {
   // Unbind the texture
   glBindTexture(GL_TEXTURE_2D, 0);
 }
+
+void RenderManager::_initVideoShader() {
+  // Without shaders, videos are converted to RGB on the CPU instead
+  if (!glewIsSupported("GL_VERSION_2_0")) {
+    log.warning(kModRender, "%s", kString11007);
+    config.videoShader = false;
+    return;
+  }
+  
+  const char* pointerToData = kVideoShaderData;
+  GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fragment, 1, &pointerToData, NULL);
+  glCompileShader(fragment);
+  
+  _videoProgram = glCreateProgram();
+  glAttachShader(_videoProgram, fragment);
+  glLinkProgram(_videoProgram);
+  
+  // Flagged for deletion along with the program
+  glDeleteShader(fragment);
+  
+  GLint status;
+  glGetProgramiv(_videoProgram, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    log.warning(kModRender, "%s", kString11007);
+    glDeleteProgram(_videoProgram);
+    _videoProgram = 0;
+    config.videoShader = false;
+    return;
+  }
+  
+  // Planes are always bound to the same units
+  glUseProgram(_videoProgram);
+  glUniform1i(glGetUniformLocation(_videoProgram, "TextureY"), 0);
+  glUniform1i(glGetUniformLocation(_videoProgram, "TextureU"), 1);
+  glUniform1i(glGetUniformLocation(_videoProgram, "TextureV"), 2);
+  glUseProgram(0);
+}
   
 }
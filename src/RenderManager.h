@@ -38,6 +38,9 @@ class Texture;
 // Reference to embedded splash screen
 extern "C" const unsigned char kSplashData[];
 
+// Reference to embedded video shader
+extern "C" const char kVideoShaderData[];
+
 ////////////////////////////////////////////////////////////
 // Interface - Singleton class
 ////////////////////////////////////////////////////////////
@@ -51,6 +54,9 @@ class RenderManager {
   GLuint _fboDepth; // The depth buffer for the frame buffer object
   GLuint _fboTexture; // The texture object to write our frame buffer object to
   
+  GLuint _videoProgram; // Converts planar video frames
+  GLint _previousProgram;
+  
   bool _blendNextUpdate;
   float _blendOpacity;
   GLfloat _defCursor[(kDefCursorDetail * 2) + 2];
@@ -65,10 +71,17 @@ class RenderManager {
   Texture* _blendTexture;
   Texture* _fadeTexture;
   
+  // Sprites queued for the next batch, two triangles each
+  std::vector<GLubyte> _spriteColors;
+  std::vector<GLfloat> _spriteTexCoords;
+  std::vector<GLuint> _spriteTextures;
+  std::vector<GLfloat> _spriteVertices;
+  
   Point _centerOfPolygon(std::vector<int> arrayOfCoordinates); // Used for the helpers feature
   void _initFrameBuffer();
   void _initFrameBufferDepthBuffer();
   void _initFrameBufferTexture();
+  void _initVideoShader();
   
   std::vector<Point> _arrayOfHelpers;
   std::vector<Point>::iterator _itHelper;
@@ -103,13 +116,17 @@ public:
   void enableAlpha();
   void enablePostprocess();
   void enableTextures();
+  void enableVideoShader(); // For textures holding planar video frames
   void disableAlpha();
   void disablePostprocess();
   void disableTextures();
+  void disableVideoShader();
   void drawHelper(int xPosition, int yPosition, bool animate);
   void drawPolygon(std::vector<int> withArrayOfCoordinates, unsigned int onFace);
   void drawPostprocessedView(); // Expects orthogonal mode
   void drawSlide(float* withArrayOfCoordinates);
+  void drawSprite(Texture* texture, float* withArrayOfCoordinates, float alpha);
+  void flushSprites();
   void setAlpha(float alpha);
   void setColor(uint32_t color, float alpha = 0);
   uint32_t    testColor(int xPosition, int yPosition);
@@ -115,6 +115,7 @@ void Room::setEnterEvent(int luaReference) {
 ////////////////////////////////////////////////////////////
 
 Audio* Room::addAudio(Audio* anAudio) {
+  anAudio->setPriority(kAudioPriorityAmbient);
   _arrayOfAudios.push_back(anAudio);
   return anAudio;
 }
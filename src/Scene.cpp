@@ -49,6 +49,7 @@ renderManager(RenderManager::instance()),
 videoManager(VideoManager::instance())
 {
   _canDrawSpots = false;
+  _cutsceneTexture = NULL;
   _isCutsceneLoaded = false;
   _isSplashLoaded = false;
 }
@@ -102,11 +103,16 @@ void Scene::drawSpots(bool disableVideos) {
                 if (spot->video()->hasNewFrame() && !disableVideos) {
                   DGFrame* frame = spot->video()->currentFrame();
                   Texture* texture = spot->texture();
-                  texture->loadRawData(frame->data, frame->width, frame->height);
+                  texture->loadFrameData(frame->data, frame->width, frame->height, frame->depth);
                 }
                 
+                bool isPlanar = spot->texture()->isPlanar();
+                if (isPlanar)
+                  renderManager.enableVideoShader();
                 spot->texture()->bind();
                 renderManager.drawPolygon(spot->arrayOfCoordinates(), spot->face());
+                if (isPlanar)
+                  renderManager.disableVideoShader();
               }
             }
             else {
@@ -246,7 +252,7 @@ bool Scene::drawCutscene() {
   if (_cutscene.isPlaying()) {
     if (_cutscene.hasNewFrame()) {
       DGFrame* frame = _cutscene.currentFrame();
-      _cutsceneTexture->loadRawData(frame->data, frame->width, frame->height);
+      _cutsceneTexture->loadFrameData(frame->data, frame->width, frame->height, frame->depth);
     }
     
     _cutsceneTexture->bind();
@@ -260,7 +266,11 @@ bool Scene::drawCutscene() {
     renderManager.enablePostprocess();
     cameraManager.beginOrthoView();
     renderManager.enableTextures();
+    if (_cutsceneTexture->isPlanar())
+      renderManager.enableVideoShader();
     renderManager.drawSlide(coords);
+    if (_cutsceneTexture->isPlanar())
+      renderManager.disableVideoShader();
     renderManager.disablePostprocess();
     renderManager.drawPostprocessedView();
     
@@ -270,31 +280,69 @@ bool Scene::drawCutscene() {
   return false;
 }
 
+bool Scene::isCutsceneReady() {
+  if (videoManager.isPrerolling(&_cutscene))
+    return false;
+  
+  // Another one was asked for while the last was on its way
+  if (!_cutscene.hasResource() || (_cutsceneResource != _cutscene.resource())) {
+    _prerollCutscene();
+    return false;
+  }
+  
+  return true;
+}
+
 void Scene::loadCutscene(const char* fileName) {
+  _cutsceneResource = config.path(kPathResources, fileName, kObjectVideo);
+  
+  // Picked up once the one being prerolled is done
+  if (!videoManager.isPrerolling(&_cutscene))
+    _prerollCutscene();
+}
+
+bool Scene::playCutscene() {
+  if (!_cutscene.isLoaded())
+    return false;
+  
   _cutsceneTexture = new Texture;
+  _cutscene.play();
   
-  _cutscene.setResource(config.path(kPathResources, fileName, kObjectVideo).c_str());
-  videoManager.requestVideo(&_cutscene);
+  DGFrame* frame = _cutscene.currentFrame();
+  _cutsceneTexture->loadFrameData(frame->data, frame->width, frame->height, frame->depth);
   
-  if (_cutscene.isLoaded()) {
-    _cutscene.play();
-    
-    DGFrame* frame = _cutscene.currentFrame();
-    _cutsceneTexture->loadRawData(frame->data, frame->width, frame->height);
-    
-    _isCutsceneLoaded = true;
-  }
+  _isCutsceneLoaded = true;
+  return true;
 }
 
 void Scene::unloadCutscene() {
   _cutscene.unload();
+  _cutscene.release();
   
-  _cutsceneTexture->unload();
-  delete _cutsceneTexture;
+  if (_cutsceneTexture) {
+    _cutsceneTexture->unload();
+    delete _cutsceneTexture;
+    _cutsceneTexture = NULL;
+  }
   
   _isCutsceneLoaded = false;
 }
 
+void Scene::_prerollCutscene() {
+  // Nothing to do if it's still prerolled from a previous request
+  if (_cutscene.hasResource() && (_cutsceneResource == _cutscene.resource()) &&
+      _cutscene.isLoaded() && !_cutscene.isPlaying())
+    return;
+  
+  _cutscene.unload();
+  _cutscene.setResource(_cutsceneResource.c_str());
+  
+  // Keep it from being flushed on a switch until it's done playing
+  if (_cutscene.retainCount() == 0)
+    _cutscene.retain();
+  videoManager.prerollVideo(&_cutscene);
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Splash screen operations
 ////////////////////////////////////////////////////////////
@@ -56,6 +56,9 @@ class Scene {
   bool _canDrawSpots; // This bool is used to make checks faster
   bool _isCutsceneLoaded;
   bool _isSplashLoaded;
+  std::string _cutsceneResource; // Last one asked for
+  
+  void _prerollCutscene();
   
 public:
   Scene();
@@ -71,7 +74,9 @@ public:
   // Cutscene operations
   void cancelCutscene();
   bool drawCutscene();
-  void loadCutscene(const char* fileName);
+  bool isCutsceneReady();
+  void loadCutscene(const char* fileName); // Returns right away, see isCutsceneReady()
+  bool playCutscene();
   void unloadCutscene();
   
   // Splash screen operations
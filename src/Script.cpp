@@ -404,6 +404,12 @@ int Script::_globalPlay(lua_State *L) {
   return 0;
 }
 
+int Script::_globalPrepareCutscene(lua_State *L) {
+  Control::instance().prepareCutscene(luaL_checkstring(L, 1));
+  
+  return 0;
+}
+
 int Script::_globalQueue(lua_State *L) {
   FeedManager::instance().queue(luaL_checkstring(L, 1), lua_tostring(L, 2));
   
@@ -736,6 +742,7 @@ void Script::_registerGlobals() {
     {"hotkey", _globalHotkey},
     {"lookAt", _globalLookAt},
     {"play", _globalPlay},
+    {"prepareCutscene", _globalPrepareCutscene},
     {"print", _globalPrint},
     {"queue", _globalQueue},
     {"register", _globalRegister},
@@ -71,6 +71,7 @@ class Script {
   static int _globalHotkey(lua_State *L);
   static int _globalLookAt(lua_State *L);
   static int _globalPlay(lua_State *L);
+  static int _globalPrepareCutscene(lua_State *L);
   static int _globalPrint(lua_State *L);
   static int _globalQueue(lua_State *L);
   static int _globalRegister(lua_State *L);
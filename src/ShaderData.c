@@ -149,3 +149,33 @@ const char kShaderData[] =
   "\n     "
   "\n     gl_FragColor = pass;"
   "\n }";
+
+const char kFontShaderData[] =
+  "\n // Distance field text, alpha is the distance to the edge of the glyph"
+  "\n "
+  "\n uniform sampler2D tex;"
+  "\n "
+  "\n void main() {"
+  "\n   float distance = texture2D(tex, gl_TexCoord[0].st).a;"
+  "\n   float width = fwidth(distance);"
+  "\n   float alpha = smoothstep(0.5 - width, 0.5 + width, distance);"
+  "\n   "
+  "\n   gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * alpha);"
+  "\n }";
+
+const char kVideoShaderData[] =
+  "\n // Planar YUV 4:2:0 video frames, with the same coefficients as the"
+  "\n // conversion done on the CPU"
+  "\n "
+  "\n uniform sampler2D TextureY;"
+  "\n uniform sampler2D TextureU;"
+  "\n uniform sampler2D TextureV;"
+  "\n "
+  "\n void main() {"
+  "\n   float y = 1.169 * (texture2D(TextureY, gl_TexCoord[0].st).r - 0.0627);"
+  "\n   float u = texture2D(TextureU, gl_TexCoord[0].st).r - 0.502;"
+  "\n   float v = texture2D(TextureV, gl_TexCoord[0].st).r - 0.502;"
+  "\n   vec3 color = vec3(y + 1.628 * v, y - 0.393 * u - 0.841 * v, y + 2.042 * u);"
+  "\n   "
+  "\n   gl_FragColor = vec4(color, 1.0) * gl_Color;"
+  "\n }";
@@ -209,8 +209,12 @@ void Spot::play() {
   if (_hasAudio && _attachedAudio->isLoaded())
     _attachedAudio->play();
   
-  if (_hasVideo && _attachedVideo->isLoaded())
+  if (_hasVideo && _attachedVideo->isLoaded()) {
+    // Keep the video in step with its soundtrack
+    if (_hasAudio)
+      _attachedVideo->setMasterAudio(_attachedAudio);
     _attachedVideo->play();
+  }
   
   // Hack of sorts but works OK
   if (this->hasFlag(kSpotLoop))
@@ -127,6 +127,7 @@ public:
     
     // For the video attach, autoplay defaults to true
     bool autoplay, loop, sync;
+    int quality;
     
     int type = (int)luaL_checknumber(L, 1);
     
@@ -241,12 +242,16 @@ public:
         if (s->hasFlag(kSpotSync)) sync = true;
         else sync = false;
         
-        video = new Video(autoplay, loop, sync);
+        // If we have a third parameter, use it to set the post-processing level.
+        // It's part of what spots must agree on to share the video.
+        if (lua_isnumber(L, 3)) quality = static_cast<int>(lua_tonumber(L, 3));
+        else quality = Config::instance().videoQuality;
         
         // TODO: Path is set by the video manager
-        video->setResource(Config::instance().path(kPathResources, luaL_checkstring(L, 2), kObjectVideo).c_str());
+        video = VideoManager::instance().sharedVideo(Config::instance().path(kPathResources, luaL_checkstring(L, 2), kObjectVideo).c_str(),
+                                                     autoplay, loop, sync, quality);
+        
         s->setVideo(video);
-        VideoManager::instance().registerVideo(video);
         
         break;
     }
@@ -23,6 +23,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include "AudioManager.h"
 #include "Control.h"
 
 namespace dagon {
@@ -31,6 +32,26 @@ namespace dagon {
 // Interface
 ////////////////////////////////////////////////////////////
 
+static int SystemLibAudioStats(lua_State *L) {
+  AudioStats stats = AudioManager::instance().stats();
+  
+  lua_newtable(L);
+  lua_pushnumber(L, stats.underruns);
+  lua_setfield(L, -2, "underruns");
+  lua_pushnumber(L, stats.blocks ? stats.decodeTime / stats.blocks : 0.0);
+  lua_setfield(L, -2, "decodeTime");
+  lua_pushnumber(L, stats.refills ? stats.refillLatency / stats.refills : 0.0);
+  lua_setfield(L, -2, "refillLatency");
+  lua_pushnumber(L, stats.queueDepth);
+  lua_setfield(L, -2, "queueDepth");
+  lua_pushnumber(L, stats.minQueueDepth);
+  lua_setfield(L, -2, "minQueueDepth");
+  lua_pushnumber(L, stats.streams);
+  lua_setfield(L, -2, "streams");
+  
+  return 1;
+}
+
 static int SystemLibBrowse(lua_State *L) {
   //System::instance().browse(lua_tostring(L, 1));
   
@@ -67,6 +88,7 @@ static int SystemLibTerminate(lua_State *L) {
 ////////////////////////////////////////////////////////////
 
 static const struct luaL_reg SystemLib [] = {
+  {"audioStats", SystemLibAudioStats},
   {"browse", SystemLibBrowse},
   {"init", SystemLibInit},
   {"run", SystemLibRun},
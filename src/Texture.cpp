@@ -21,6 +21,7 @@
 #include "Language.h"
 #include "Log.h"
 #include "Texture.h"
+#include "TextureManager.h"
 #include "stb_image.h"
 
 namespace dagon {
@@ -42,7 +43,11 @@ log(Log::instance())
   _hasResource = false;
   _isBitmapLoaded = false;
   _isLoaded = false;
+  _isPackable = false;
+  _isPacked = false;
+  _isPlanar = false;
   _usageCount = 0;
+  _resetTexCoords();
   _compressionLevel = config.texCompression;
   this->setType(kObjectTexture);
   _mutex = SDL_CreateMutex();
@@ -83,6 +88,10 @@ log(Log::instance())
   // The texture doesn't require a resource, so we make it clear
   _hasResource = true;
   _isLoaded = true;
+  _isPackable = false;
+  _isPacked = false;
+  _isPlanar = false;
+  _resetTexCoords();
   // Since the texture will be loaded only once, we note this
   _usageCount = 1;
   _compressionLevel = config.texCompression;
@@ -113,6 +122,14 @@ bool Texture::isLoaded() {
   return _isLoaded;
 }
 
+bool Texture::isPacked() {
+  return _isPacked;
+}
+
+bool Texture::isPlanar() {
+  return _isPlanar;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
@@ -129,10 +146,19 @@ int Texture::height() {
   return _height;
 }
 
+GLuint Texture::ident() {
+  return _ident;
+}
+
 std::string Texture::resource() {
   return _resource;
 }
 
+// Packed textures only cover a region of their atlas page
+const GLfloat* Texture::texCoords() {
+  return _texCoords;
+}
+
 unsigned int Texture::usageCount() {
   return _usageCount;
 }
@@ -155,6 +181,11 @@ void Texture::setIndexInBundle(int index) {
   _indexInBundle = index;
 }
 
+// Must be set before loading the texture
+void Texture::setPackable(bool packable) {
+  _isPackable = packable;
+}
+
 void Texture::setResource(std::string fromFileName) {
   _resource = fromFileName;
   _hasResource = true;
@@ -166,8 +197,16 @@ void Texture::setResource(std::string fromFileName) {
 
 void Texture::bind() {
   if (SDL_LockMutex(_mutex) == 0) {
-    if (_isLoaded)
+    if (_isLoaded) {
+      if (_isPlanar) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, _planes[1]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, _planes[0]);
+        glActiveTexture(GL_TEXTURE0);
+      }
       glBindTexture(GL_TEXTURE_2D, _ident);
+    }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModTexture, "%s", kString18002);
@@ -313,14 +352,16 @@ void Texture::load() {
                 break;
               }
             }
-            glGenTextures(1, &_ident);
-            glBindTexture(GL_TEXTURE_2D, _ident);
-            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height,
-                         0, format, GL_UNSIGNED_BYTE, _bitmap);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            if (!_pack()) {
+              glGenTextures(1, &_ident);
+              glBindTexture(GL_TEXTURE_2D, _ident);
+              glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, _width, _height,
+                           0, format, GL_UNSIGNED_BYTE, _bitmap);
+              glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+              glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+              glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+              glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
             free(_bitmap);
             _isBitmapLoaded = false;
             _isLoaded = true;
@@ -452,6 +493,56 @@ void Texture::loadRawData(const unsigned char* dataToLoad,
   }
 }
 
+void Texture::loadFrameData(const unsigned char* dataToLoad,
+                            int withWidth, int andHeight, int andDepth) {
+  if (andDepth == 12)
+    this->loadPlanarData(dataToLoad, withWidth, andHeight);
+  else
+    this->loadRawData(dataToLoad, withWidth, andHeight);
+}
+
+void Texture::loadPlanarData(const unsigned char* dataToLoad,
+                             int withWidth, int andHeight) {
+  // One luminance texture per plane, chroma at half the size. This uploads
+  // half as much as BGR and leaves the conversion to the video shader.
+  const unsigned char* planes[3];
+  int widths[3] = {withWidth, withWidth >> 1, withWidth >> 1};
+  int heights[3] = {andHeight, andHeight >> 1, andHeight >> 1};
+  planes[0] = dataToLoad;
+  planes[1] = planes[0] + (widths[0] * heights[0]);
+  planes[2] = planes[1] + (widths[1] * heights[1]);
+  
+  if (!_isLoaded) {
+    glGenTextures(1, &_ident);
+    glGenTextures(2, _planes);
+  }
+  
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int i = 0; i < 3; i++) {
+    glBindTexture(GL_TEXTURE_2D, i ? _planes[i - 1] : _ident);
+    if (!_isLoaded) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, widths[i], heights[i],
+                   0, GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[i]);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, widths[i], heights[i],
+                      GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[i]);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  
+  if (!_isLoaded) {
+    _width = withWidth;
+    _height = andHeight;
+    _depth = 12;
+    _isPlanar = true;
+    _isLoaded = true;
+  }
+}
+
 void Texture::saveToFile(std::string fileName){
   // NOTE: Always saves in TGA format
   if (_isLoaded) {
@@ -491,11 +582,66 @@ void Texture::saveToFile(std::string fileName){
 
 void Texture::unload() {
   if (_isLoaded) {
-    glDeleteTextures(1, &_ident);
+    // The atlas page is shared, so we only give back our region of it
+    if (_isPacked) {
+      TextureManager::instance().releaseImage(_ident, _texCoords, _width, _height);
+      _isPacked = false;
+      _resetTexCoords();
+    }
+    else glDeleteTextures(1, &_ident);
+    if (_isPlanar) {
+      glDeleteTextures(2, _planes);
+      _isPlanar = false;
+    }
     _usageCount = 0;
     _isBitmapLoaded = false;
     _isLoaded = false;
   }
 }
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+// Attempts to place the loaded bitmap in an atlas page, converting it to RGBA
+bool Texture::_pack() {
+  if (!_isPackable || _compressionLevel ||
+      _width > kAtlasMaxImageSize || _height > kAtlasMaxImageSize)
+    return false;
+  
+  std::vector<GLubyte> data(_width * _height * 4);
+  for (int i = 0; i < _width * _height; i++) {
+    GLubyte* pixel = &data[i * 4];
+    
+    switch (_depth) {
+      case STBI_grey:
+        pixel[0] = pixel[1] = pixel[2] = _bitmap[i];
+        pixel[3] = 0xFF;
+        break;
+      case STBI_grey_alpha:
+        pixel[0] = pixel[1] = pixel[2] = _bitmap[i * 2];
+        pixel[3] = _bitmap[i * 2 + 1];
+        break;
+      case STBI_rgb:
+        memcpy(pixel, &_bitmap[i * 3], 3);
+        pixel[3] = 0xFF;
+        break;
+      case STBI_rgb_alpha:
+        memcpy(pixel, &_bitmap[i * 4], 4);
+        break;
+      default:
+        return false;
+    }
+  }
+  
+  _isPacked = TextureManager::instance().packImage(&data[0], _width, _height,
+                                                   &_ident, _texCoords);
+  return _isPacked;
+}
+
+void Texture::_resetTexCoords() {
+  const GLfloat texCoords[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+  memcpy(_texCoords, texCoords, sizeof(_texCoords));
+}
   
 }
@@ -65,18 +65,23 @@ class Texture : public Object {
   // Checks
   bool hasResource();
   bool isLoaded();
+  bool isPacked();
+  bool isPlanar();
   
   // Gets
   int depth();
   int indexInBundle();
   int height();
+  GLuint ident();
   std::string resource();
+  const GLfloat* texCoords();
   unsigned int usageCount();
   int width();
   
   // Sets
   void increaseUsageCount();
   void setIndexInBundle(int index);
+  void setPackable(bool packable);
   void setResource(std::string fromFileName);
   
   // State changes
@@ -89,6 +94,13 @@ class Texture : public Object {
   void loadFromMemory(const unsigned char* dataToLoad, long size);
   void loadRawData(const unsigned char* dataToLoad,
                    int withWidth, int andHeight);
+  
+  // Video frames are either packed BGR (24 bits) or planar YUV 4:2:0
+  // (12 bits), the latter drawn with the video shader
+  void loadFrameData(const unsigned char* dataToLoad,
+                     int withWidth, int andHeight, int andDepth);
+  void loadPlanarData(const unsigned char* dataToLoad,
+                      int withWidth, int andHeight);
   void saveToFile(std::string fileName);
   void unload();
   
@@ -105,6 +117,11 @@ class Texture : public Object {
   int _indexInBundle;
   bool _isBitmapLoaded;
   bool _isLoaded;
+  bool _isPackable; // Small images may be packed into a shared atlas
+  bool _isPacked;
+  bool _isPlanar;
+  GLuint _planes[2]; // Chroma planes, luma goes in the main texture
+  GLfloat _texCoords[8];
   unsigned int _usageCount; // Used to keep track of the most used textures
   GLint _width;
   
@@ -112,6 +129,9 @@ class Texture : public Object {
   // Eventually all file management will be handled by a ResourceManager object
   std::string _resource;
   
+  bool _pack();
+  void _resetTexCoords();
+  
   Texture(const Texture&);
   void operator=(const Texture&);
 };
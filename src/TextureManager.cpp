@@ -15,6 +15,9 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <cstring>
+
 #include "Config.h"
 #include "Log.h"
 #include "Node.h"
@@ -56,6 +59,9 @@ TextureManager::~TextureManager() {
       ++it;
     }
   }
+  
+  for (std::size_t i = 0; i < _arrayOfPages.size(); i++)
+    glDeleteTextures(1, &_arrayOfPages[i].ident);
 }
 
 ////////////////////////////////////////////////////////////
@@ -98,6 +104,140 @@ void TextureManager::init() {
    });*/
 }
 
+// Expects RGBA data. Regions are given back with releaseImage() when the
+// texture is unloaded.
+bool TextureManager::packImage(const GLubyte* data, int width, int height,
+                               GLuint* page, GLfloat* texCoords) {
+  // Each image is surrounded by copies of its edge texels, so that linear
+  // filtering never blends in its neighbours
+  int paddedWidth = width + (kAtlasPadding * 2);
+  int paddedHeight = height + (kAtlasPadding * 2);
+  std::size_t index = 0;
+  int x = 0, y = 0;
+  bool fits = false;
+  
+  while (!fits && index <= _arrayOfPages.size()) {
+    if (index == _arrayOfPages.size()) {
+      if (_arrayOfPages.size() >= static_cast<std::size_t>(kAtlasMaxPages))
+        return false;
+      
+      AtlasPage newPage;
+      newPage.numOfImages = 0;
+      newPage.shelfHeight = 0;
+      newPage.shelfX = 0;
+      newPage.shelfY = 0;
+      
+      glGenTextures(1, &newPage.ident);
+      glBindTexture(GL_TEXTURE_2D, newPage.ident);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kAtlasPageSize, kAtlasPageSize,
+                   0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      _arrayOfPages.push_back(newPage);
+    }
+    
+    // Reuse a region freed by an unloaded image first, handing back what's
+    // left of it to the right and below
+    AtlasPage& current = _arrayOfPages[index];
+    for (std::size_t i = 0; !fits && (i < current.freeRegions.size()); i++) {
+      AtlasRegion region = current.freeRegions[i];
+      if ((region.width >= paddedWidth) && (region.height >= paddedHeight)) {
+        current.freeRegions.erase(current.freeRegions.begin() + i);
+        AtlasRegion right = {region.x + paddedWidth, region.y,
+                             region.width - paddedWidth, paddedHeight};
+        AtlasRegion below = {region.x, region.y + paddedHeight,
+                             region.width, region.height - paddedHeight};
+        if (right.width > 0)
+          current.freeRegions.push_back(right);
+        if (below.height > 0)
+          current.freeRegions.push_back(below);
+        x = region.x;
+        y = region.y;
+        fits = true;
+      }
+    }
+    if (fits)
+      break;
+    
+    // Same shelf packing as the font atlas. The next shelf is only opened
+    // once the image is known to fit there, so that a tall image that fails
+    // doesn't close the current shelf to smaller ones.
+    int shelfX = current.shelfX;
+    int shelfY = current.shelfY;
+    int shelfHeight = current.shelfHeight;
+    if (shelfX + paddedWidth > kAtlasPageSize) {
+      shelfX = 0;
+      shelfY += shelfHeight;
+      shelfHeight = 0;
+    }
+    
+    if ((shelfX + paddedWidth <= kAtlasPageSize) &&
+        (shelfY + paddedHeight <= kAtlasPageSize)) {
+      x = shelfX;
+      y = shelfY;
+      current.shelfX = shelfX + paddedWidth;
+      current.shelfY = shelfY;
+      current.shelfHeight = std::max(shelfHeight, paddedHeight);
+      fits = true;
+    }
+    else index++;
+  }
+  
+  std::vector<GLubyte> padded(paddedWidth * paddedHeight * 4);
+  for (int row = 0; row < paddedHeight; row++) {
+    int sourceRow = std::min(std::max(row - kAtlasPadding, 0), height - 1);
+    for (int column = 0; column < paddedWidth; column++) {
+      int sourceColumn = std::min(std::max(column - kAtlasPadding, 0), width - 1);
+      memcpy(&padded[(row * paddedWidth + column) * 4],
+             &data[(sourceRow * width + sourceColumn) * 4], 4);
+    }
+  }
+  
+  glBindTexture(GL_TEXTURE_2D, _arrayOfPages[index].ident);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, paddedWidth, paddedHeight,
+                  GL_RGBA, GL_UNSIGNED_BYTE, &padded[0]);
+  _arrayOfPages[index].numOfImages++;
+  
+  x += kAtlasPadding;
+  y += kAtlasPadding;
+  GLfloat s0 = static_cast<GLfloat>(x) / kAtlasPageSize;
+  GLfloat t0 = static_cast<GLfloat>(y) / kAtlasPageSize;
+  GLfloat s1 = static_cast<GLfloat>(x + width) / kAtlasPageSize;
+  GLfloat t1 = static_cast<GLfloat>(y + height) / kAtlasPageSize;
+  GLfloat coords[] = {s0, t0, s1, t0, s1, t1, s0, t1};
+  memcpy(texCoords, coords, sizeof(coords));
+  
+  *page = _arrayOfPages[index].ident;
+  return true;
+}
+
+void TextureManager::releaseImage(GLuint page, const GLfloat* texCoords,
+                                  int width, int height) {
+  for (std::size_t i = 0; i < _arrayOfPages.size(); i++) {
+    AtlasPage& current = _arrayOfPages[i];
+    if (current.ident == page) {
+      if (--current.numOfImages <= 0) {
+        current.numOfImages = 0;
+        current.shelfHeight = 0;
+        current.shelfX = 0;
+        current.shelfY = 0;
+        current.freeRegions.clear();
+      } else {
+        // Coordinates are whole texels over a power of two, so they're exact
+        AtlasRegion region;
+        region.x = static_cast<int>(texCoords[0] * kAtlasPageSize + 0.5f) - kAtlasPadding;
+        region.y = static_cast<int>(texCoords[1] * kAtlasPageSize + 0.5f) - kAtlasPadding;
+        region.width = width + (kAtlasPadding * 2);
+        region.height = height + (kAtlasPadding * 2);
+        current.freeRegions.push_back(region);
+      }
+      break;
+    }
+  }
+}
+
 void TextureManager::registerTexture(Texture* target) {
   // FIXME: If the script specifies a file with extension, we should
   // prioritize that and avoid doing any operations here.
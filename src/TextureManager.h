@@ -34,6 +34,31 @@ namespace dagon {
 // before the next switch.
 #define kMaxActiveTextures 18
 
+// Small overlay images are packed into shared atlas pages so that they can
+// be drawn in batches
+const int kAtlasMaxImageSize = 256;
+const int kAtlasMaxPages = 4;
+const int kAtlasPadding = 1;
+const int kAtlasPageSize = 1024;
+
+typedef struct {
+  int x;
+  int y;
+  int width;
+  int height;
+} AtlasRegion;
+
+// Regions given back by unloaded images are reused before the shelves grow,
+// and the whole page starts over once it holds no images at all
+typedef struct {
+  GLuint ident;
+  int numOfImages;
+  int shelfHeight;
+  int shelfX;
+  int shelfY;
+  std::vector<AtlasRegion> freeRegions;
+} AtlasPage;
+
 class Config;
 class Log;
 class Node;
@@ -52,6 +77,7 @@ class TextureManager {
   Log& log;
   
   std::vector<Texture*> _arrayOfActiveTextures;
+  std::vector<AtlasPage> _arrayOfPages;
   std::vector<Texture*> _arrayOfTextures;
   
   Room* _roomToPreload;
@@ -72,6 +98,9 @@ public:
   int itemsInBundle(const char* nameOfBundle);
   void flush();
   void init();
+  bool packImage(const GLubyte* data, int width, int height,
+                 GLuint* page, GLfloat* texCoords);
+  void releaseImage(GLuint page, const GLfloat* texCoords, int width, int height);
   void registerTexture(Texture* target);
   void requestBundle(Node* forNode);
   void requestTexture(Texture* target);
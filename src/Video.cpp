@@ -15,14 +15,30 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <vector>
+
 #include <SDL2/SDL.h>
 
+#include "Audio.h"
+#include "Config.h"
 #include "Defines.h"
 #include "Language.h"
 #include "Log.h"
+#include "Platform.h"
 #include "Video.h"
 
-// TODO: Use 1.1 API calls
+#ifdef DAGON_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef DAGON_AVX2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
 namespace dagon {
 
@@ -42,17 +58,55 @@ struct DGLookUpTable{
 
 static struct DGLookUpTable _lookUpTable;
 
+typedef void (*DGConvertRowsFunction)(const uint8_t*, const uint8_t*,
+                                      const uint8_t*, const uint8_t*,
+                                      uint8_t*, uint8_t*, int);
+
+// Picked once at runtime according to what the CPU supports
+static DGConvertRowsFunction _convertRowsFunction = NULL;
+
+#ifdef DAGON_AVX2
+
+// AVX2 needs both the CPU and the OS, which must save the wider registers
+static bool DGHasAVX2() {
+  unsigned int info[4];
+  unsigned long long xcr0;
+#if defined(_MSC_VER)
+  __cpuid(reinterpret_cast<int*>(info), 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(reinterpret_cast<int*>(info), 1);
+  if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+    return false;
+  xcr0 = _xgetbv(0);
+  __cpuidex(reinterpret_cast<int*>(info), 7, 0);
+#else
+  if (__get_cpuid_max(0, NULL) < 7)
+    return false;
+  __cpuid(1, info[0], info[1], info[2], info[3]);
+  if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+    return false;
+  unsigned int low, high;
+  __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  xcr0 = (static_cast<unsigned long long>(high) << 32) | low;
+  __cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+  return ((xcr0 & 0x6) == 0x6) && (info[1] & (1 << 5));
+}
+
+#endif
+
 ////////////////////////////////////////////////////////////
 // Implementation - Constructor
 ////////////////////////////////////////////////////////////
 
 Video::Video() :
+config(Config::instance()),
 log(Log::instance())
 {
   this->setType(kObjectVideo);
   
   _handle = NULL;
-  _hasNewFrame = false;
   _hasResource = false;
   _isLoaded = false;
   _state = VideoInitial;
@@ -60,15 +114,43 @@ log(Log::instance())
   _doesAutoplay = true;
   _isLoopable = false;
   _isSynced = false;
+  _texture = NULL;
   
   _theoraInfo = new DGTheoraInfo;
 
-  _theoraInfo->bos = 0;
+  _theoraInfo->ts = NULL;
+  _theoraInfo->td = NULL;
   _theoraInfo->theora_p = 0;
   _theoraInfo->videobuf_ready = 0;
   _theoraInfo->videobuf_granulepos -= 1;
   _theoraInfo->videobuf_time = 0;
   
+  for (int i = 0; i < VideoFrameSlots; i++)
+    _frames[i].data = NULL;
+  SDL_AtomicSet(&_droppedFrames, 0);
+  _readIndex = 0;
+  _writeIndex = 1;
+  _numOfQueued = 0;
+  _queueLock = 0;
+  
+  _masterAudio = NULL;
+  _clockBase = 0.0;
+  _pauseTime = 0.0;
+  _timeOffset = 0.0;
+  _lastFrameTime = 0.0;
+  _endTime = 0.0;
+  _hasTimeBase = false;
+  _isDraining = false;
+  _dataOffset = 0;
+  _frameDuration = 0.0;
+  _readSize = VideoBuffer;
+  _bytesRead = 0;
+  _framesDecoded = 0;
+  
+  _isConvertingStripes = false;
+  _hasStripes = false;
+  _quality = config.videoQuality;
+  
   _initConversionToRGB();
   _mutex = SDL_CreateMutex();
   if (!_mutex)
@@ -76,6 +158,7 @@ log(Log::instance())
 }
 
 Video::Video(bool autoplay, bool loopable, bool synced)  :
+config(Config::instance()),
 log(Log::instance())
 {
   this->setType(kObjectVideo);
@@ -87,15 +170,43 @@ log(Log::instance())
   _doesAutoplay = autoplay;
   _isLoopable = loopable;
   _isSynced = synced;
+  _texture = NULL;
   
   _theoraInfo = new DGTheoraInfo;
   
-  _theoraInfo->bos = 0;
+  _theoraInfo->ts = NULL;
+  _theoraInfo->td = NULL;
   _theoraInfo->theora_p = 0;
   _theoraInfo->videobuf_ready = 0;
   _theoraInfo->videobuf_granulepos -= 1;
   _theoraInfo->videobuf_time = 0;
   
+  for (int i = 0; i < VideoFrameSlots; i++)
+    _frames[i].data = NULL;
+  SDL_AtomicSet(&_droppedFrames, 0);
+  _readIndex = 0;
+  _writeIndex = 1;
+  _numOfQueued = 0;
+  _queueLock = 0;
+  
+  _masterAudio = NULL;
+  _clockBase = 0.0;
+  _pauseTime = 0.0;
+  _timeOffset = 0.0;
+  _lastFrameTime = 0.0;
+  _endTime = 0.0;
+  _hasTimeBase = false;
+  _isDraining = false;
+  _dataOffset = 0;
+  _frameDuration = 0.0;
+  _readSize = VideoBuffer;
+  _bytesRead = 0;
+  _framesDecoded = 0;
+  
+  _isConvertingStripes = false;
+  _hasStripes = false;
+  _quality = config.videoQuality;
+  
   _initConversionToRGB();
   _mutex = SDL_CreateMutex();
   if (!_mutex)
@@ -121,18 +232,21 @@ bool Video::doesAutoplay() {
 }
 
 bool Video::hasNewFrame() {
-  if (_hasNewFrame) {
-    _hasNewFrame = false;
-    return true;
-  }
-  
-  return false;
+  SDL_AtomicLock(&_queueLock);
+  bool value = (_numOfQueued > 0) &&
+               (_frames[(_readIndex + 1) % VideoFrameSlots].time <= _clock());
+  SDL_AtomicUnlock(&_queueLock);
+  return value;
 }
 
 bool Video::hasResource() {
   return _hasResource;
 }
 
+bool Video::hasTexture() {
+  return _texture != NULL;
+}
+
 bool Video::isLoaded() {
   return _isLoaded;
 }
@@ -153,20 +267,78 @@ bool Video::isSynced() {
 // Implementation - Gets
 ////////////////////////////////////////////////////////////
 
+double Video::clock() {
+  SDL_AtomicLock(&_queueLock);
+  double value = _clock();
+  SDL_AtomicUnlock(&_queueLock);
+  return value;
+}
+
 DGFrame* Video::currentFrame() {
-  if (SDL_LockMutex(_mutex) == 0) {
-	memcpy(_auxFrame.data, _currentFrame.data, (_theoraInfo->ti.width * _theoraInfo->ti.height) * 3);
-    SDL_UnlockMutex(_mutex);
-  } else {
-    log.error(kModVideo, "%s", kString18002);
+  // Take the latest frame that is due. Any earlier ones were never shown.
+  int skipped = -1;
+  SDL_AtomicLock(&_queueLock);
+  double time = _clock();
+  while ((_numOfQueued > 0) &&
+         (_frames[(_readIndex + 1) % VideoFrameSlots].time <= time)) {
+    _readIndex = (_readIndex + 1) % VideoFrameSlots;
+    _numOfQueued--;
+    skipped++;
   }
-  return &_auxFrame;
+  SDL_AtomicUnlock(&_queueLock);
+  
+  if (skipped > 0)
+    SDL_AtomicAdd(&_droppedFrames, skipped);
+  return &_frames[_readIndex];
+}
+
+int Video::droppedFrames() {
+  return SDL_AtomicGet(&_droppedFrames);
+}
+
+int Video::quality() {
+  return _quality;
 }
 
 const char* Video::resource() {
   return _resource;
 }
 
+Texture* Video::texture() {
+  return _texture;
+}
+
+int Video::timeToNextFrame() {
+  int value = -1;
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_state == VideoPlaying) {
+      _followMaster();
+      
+      SDL_AtomicLock(&_queueLock);
+      double time = _clock();
+      double due = time;
+      if (_isDraining) {
+        // Nothing left to decode, just stop once the last frame is over
+        due = _endTime;
+      } else if (_numOfQueued == VideoQueueFrames) {
+        // Full, so wait until the renderer takes the next frame. If it's
+        // overdue, the video isn't being drawn and we check back later.
+        due = _frames[(_readIndex + 1) % VideoFrameSlots].time;
+        if (due <= time)
+          due = time + (_frameDuration / 1000.0);
+      }
+      SDL_AtomicUnlock(&_queueLock);
+      
+      double remaining = (due - time) * 1000.0;
+      value = remaining > 0.0 ? static_cast<int>(ceil(remaining)) : 0;
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+  return value;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - Sets
 ////////////////////////////////////////////////////////////
@@ -179,6 +351,31 @@ void Video::setLoopable(bool loopable) {
   _isLoopable = loopable;
 }
 
+void Video::setMasterAudio(Audio* audio) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    // Spots sharing this video can't each follow a soundtrack of their own,
+    // so the first one keeps it
+    if (_masterAudio && (_masterAudio != audio))
+      log.warning(kModVideo, "%s: %s", kString17011, _resource);
+    else
+      _masterAudio = audio;
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
+void Video::setQuality(int level) {
+  if (SDL_LockMutex(_mutex) == 0) {
+    _quality = level;
+    if (_isLoaded && _theoraInfo->td)
+      _applyQuality();
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
 void Video::setResource(const char* fromFileName) {
   strncpy(_resource, fromFileName, kMaxFileLength);
   _hasResource = true;
@@ -188,6 +385,10 @@ void Video::setSynced(bool synced) {
   _isSynced = synced;
 }
 
+void Video::setTexture(Texture* texture) {
+  _texture = texture;
+}
+
 ////////////////////////////////////////////////////////////
 // Implementation - State changes
 ////////////////////////////////////////////////////////////
@@ -211,10 +412,13 @@ void Video::load() {
       return;
     }
     
+    _readSize = VideoBuffer;
+    _bytesRead = 0;
+    _framesDecoded = 0;
     ogg_sync_init(&_theoraInfo->oy);
     
-    theora_comment_init(&_theoraInfo->tc);
-    theora_info_init(&_theoraInfo->ti);
+    th_comment_init(&_theoraInfo->tc);
+    th_info_init(&_theoraInfo->ti);
     
     while (!stateFlag) {
       std::size_t ret = _bufferData(&_theoraInfo->oy);
@@ -236,7 +440,8 @@ void Video::load() {
         ogg_stream_packetout(&test, &_theoraInfo->op);
         
         if (!_theoraInfo->theora_p &&
-            theora_decode_header(&_theoraInfo->ti, &_theoraInfo->tc, &_theoraInfo->op) >= 0) {
+            th_decode_headerin(&_theoraInfo->ti, &_theoraInfo->tc,
+                               &_theoraInfo->ts, &_theoraInfo->op) >= 0) {
           memcpy(&_theoraInfo->to, &test, sizeof(test));
           _theoraInfo->theora_p = 1;
         } else {
@@ -256,7 +461,8 @@ void Video::load() {
           return;
         }
         
-        if (theora_decode_header(&_theoraInfo->ti, &_theoraInfo->tc, &_theoraInfo->op)) {
+        if (th_decode_headerin(&_theoraInfo->ti, &_theoraInfo->tc,
+                               &_theoraInfo->ts, &_theoraInfo->op) < 0) {
           log.error(kModVideo, "%s", kString17008);
 		  SDL_UnlockMutex(_mutex);
           return;
@@ -280,26 +486,46 @@ void Video::load() {
     }
     
     if (_theoraInfo->theora_p) {
-      theora_decode_init(&_theoraInfo->td, &_theoraInfo->ti);
+      _theoraInfo->td = th_decode_alloc(&_theoraInfo->ti, _theoraInfo->ts);
+      
+      th_stripe_callback callback;
+      callback.ctx = this;
+      callback.stripe_decoded = _outputStripe;
+      th_decode_ctl(_theoraInfo->td, TH_DECCTL_SET_STRIPE_CB, &callback, sizeof(callback));
+      _applyQuality();
     } else {
-      theora_info_clear(&_theoraInfo->ti);
-      theora_comment_clear(&_theoraInfo->tc);
+      th_info_clear(&_theoraInfo->ti);
+      th_comment_clear(&_theoraInfo->tc);
     }
+    th_setup_free(_theoraInfo->ts);
+    _theoraInfo->ts = NULL;
     
-    _currentFrame.width = _theoraInfo->ti.width;
-    _currentFrame.height = _theoraInfo->ti.height;
-    _currentFrame.depth = 24; // NOTE: We only support flat RGB for now
-    _currentFrame.data = (unsigned char*)malloc((_theoraInfo->ti.width * _theoraInfo->ti.height) * 3);
-
-	_auxFrame.width = _currentFrame.width;
-	_auxFrame.height = _currentFrame.height;
-	_auxFrame.depth = _currentFrame.depth;
-	_auxFrame.data = (unsigned char*)malloc((_theoraInfo->ti.width * _theoraInfo->ti.height) * 3);
+    // Planar frames are converted by the video shader, otherwise we convert
+    // to flat RGB here
+    int depth = config.videoShader ? 12 : 24;
+    std::size_t size = (_theoraInfo->ti.frame_width * _theoraInfo->ti.frame_height * depth) / 8;
+    for (int i = 0; i < VideoFrameSlots; i++) {
+      _frames[i].width = _theoraInfo->ti.frame_width;
+      _frames[i].height = _theoraInfo->ti.frame_height;
+      _frames[i].depth = depth;
+      _frames[i].data = (unsigned char*)calloc(size, 1);
+      _frames[i].time = 0.0;
+    }
+    _readIndex = 0;
+    _writeIndex = 1;
+    _numOfQueued = 0;
     
     while (ogg_sync_pageout(&_theoraInfo->oy, &_theoraInfo->og) > 0) {
       _queuePage(_theoraInfo, &_theoraInfo->og);
     }
     
+    // Headers take pages of their own, so this is where loops start over
+    if (_theoraInfo->theora_p) {
+      long position = ftell(_handle);
+      _dataOffset = _scanForData();
+      fseek(_handle, position, SEEK_SET);
+    }
+    
     _frameDuration = (double)(1.0/((double)_theoraInfo->ti.fps_numerator / (double)_theoraInfo->ti.fps_denominator)) * 1000.0;
     _isLoaded = true;
     SDL_UnlockMutex(_mutex);
@@ -310,15 +536,16 @@ void Video::load() {
 
 void Video::play() {
   if (SDL_LockMutex(_mutex) == 0) {
-    _state = VideoPlaying;
-    yuv_buffer yuv;
-    _prepareFrame();
-    theora_decode_YUVout(&_theoraInfo->td, &yuv);
-    _convertToRGB(yuv.y, yuv.y_stride,
-                  yuv.u, yuv.v, yuv.uv_stride,
-                  _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
-    
-    _lastTime = SDL_GetTicks();
+    double now = static_cast<double>(SDL_GetPerformanceCounter()) / SDL_GetPerformanceFrequency();
+    if (_state == VideoPaused) {
+      // Resume the clock where it was left
+      SDL_AtomicLock(&_queueLock);
+      _clockBase += now - _pauseTime;
+      _state = VideoPlaying;
+      SDL_AtomicUnlock(&_queueLock);
+    } else if (_state != VideoPlaying) {
+      _start();
+    }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModVideo, "%s", kString18002);
@@ -327,8 +554,45 @@ void Video::play() {
 
 void Video::pause() {
   if (SDL_LockMutex(_mutex) == 0) {
-    if (_state == VideoPlaying)
+    if (_state == VideoPlaying) {
+      SDL_AtomicLock(&_queueLock);
+      _pauseTime = static_cast<double>(SDL_GetPerformanceCounter()) / SDL_GetPerformanceFrequency();
+      _state = VideoPaused;
+      SDL_AtomicUnlock(&_queueLock);
+    }
+    SDL_UnlockMutex(_mutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
+void Video::preroll() {
+  if (!this->isLoaded())
+    this->load();
+  
+  if (SDL_LockMutex(_mutex) == 0) {
+    if (_isLoaded && (_state != VideoPlaying) && (_state != VideoPaused)) {
+      _start();
+      
+      bool isFull = false;
+      while (!isFull && !_isDraining) {
+        _isConvertingStripes = true;
+        _hasStripes = false;
+        if (!_prepareFrame())
+          break;
+        _outputFrame(_frameTime());
+        
+        SDL_AtomicLock(&_queueLock);
+        isFull = (_numOfQueued == VideoQueueFrames);
+        SDL_AtomicUnlock(&_queueLock);
+      }
+      
+      // Hold the clock at the first frame until we're told to play
+      SDL_AtomicLock(&_queueLock);
+      _pauseTime = _clockBase;
       _state = VideoPaused;
+      SDL_AtomicUnlock(&_queueLock);
+    }
     SDL_UnlockMutex(_mutex);
   } else {
     log.error(kModVideo, "%s", kString18002);
@@ -339,9 +603,8 @@ void Video::stop() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == VideoPlaying) {
       _state = VideoStopped;
-      // Rewind
-      fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
-      ogg_stream_reset(&_theoraInfo->to);
+      _rewind();
+      _flushFrames();
     }
     SDL_UnlockMutex(_mutex);
   } else {
@@ -361,20 +624,23 @@ void Video::unload() {
       
       if (_theoraInfo->theora_p) {
         // Rewind and reset
-        fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
-        ogg_stream_reset(&_theoraInfo->to);
+        _rewind();
         ogg_stream_clear(&_theoraInfo->to);
-        theora_clear(&_theoraInfo->td);
-        theora_comment_clear(&_theoraInfo->tc);
-        theora_info_clear(&_theoraInfo->ti);
+        th_decode_free(_theoraInfo->td);
+        _theoraInfo->td = NULL;
+        th_comment_clear(&_theoraInfo->tc);
+        th_info_clear(&_theoraInfo->ti);
       }
       
       ogg_sync_clear(&_theoraInfo->oy);
       
       _theoraInfo->theora_p = 0;
       
-      free(_currentFrame.data);
-	  free(_auxFrame.data);
+      _flushFrames();
+      for (int i = 0; i < VideoFrameSlots; i++) {
+        free(_frames[i].data);
+        _frames[i].data = NULL;
+      }
       fclose(_handle);
     }
     SDL_UnlockMutex(_mutex);
@@ -386,24 +652,41 @@ void Video::unload() {
 void Video::update() {
   if (SDL_LockMutex(_mutex) == 0) {
     if (_state == VideoPlaying) {
-      double currentTime = SDL_GetTicks();
-      double duration = currentTime - _lastTime;
-      if (duration >= _frameDuration) {
-        yuv_buffer yuv;
-        
-        // TODO: Skip frames if required here?
-        int frames = (int)floor(duration / _frameDuration);
-        for (int i = 0; i < frames; i++)
-          _prepareFrame();
-        
-        theora_decode_YUVout(&_theoraInfo->td, &yuv);
-        _convertToRGB(yuv.y, yuv.y_stride,
-                      yuv.u, yuv.v, yuv.uv_stride,
-                      _currentFrame.data, _theoraInfo->ti.width, _theoraInfo->ti.height, _theoraInfo->ti.width);
-        
-        _lastTime = currentTime;
+      if (_isDraining) {
+        if (this->clock() >= _endTime) {
+          _state = VideoStopped;
+          _rewind();
+        }
+      } else {
+        SDL_AtomicLock(&_queueLock);
+        bool isFull = (_numOfQueued == VideoQueueFrames);
+        SDL_AtomicUnlock(&_queueLock);
         
-        _hasNewFrame = true;
+        // Later frames depend on the ones we're late for, so those are still
+        // decoded, but not converted nor queued
+        double step = _frameDuration / 1000.0;
+        int skipped = 0;
+        while (!isFull) {
+          // Guess from the last frame whether this one is late, so that
+          // its stripes aren't converted for nothing
+          bool isLate = (skipped < VideoMaxLateFrames) && _hasTimeBase &&
+                        ((_lastFrameTime + (2.0 * step)) < this->clock());
+          _isConvertingStripes = !isLate;
+          _hasStripes = false;
+          if (!_prepareFrame())
+            break;
+          
+          double time = _frameTime();
+          if (isLate && ((time + step) < this->clock())) {
+            skipped++;
+            continue;
+          }
+          
+          _outputFrame(time);
+          break;
+        }
+        if (skipped > 0)
+          SDL_AtomicAdd(&_droppedFrames, skipped);
       }
     }
     SDL_UnlockMutex(_mutex);
@@ -416,12 +699,22 @@ void Video::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
+// Call with the queue locked
+double Video::_clock() {
+  double now = (_state == VideoPaused) ? _pauseTime :
+    static_cast<double>(SDL_GetPerformanceCounter()) / SDL_GetPerformanceFrequency();
+  return now - _clockBase;
+}
+
 std::size_t Video::_bufferData(ogg_sync_state* oy) {
-  char *buffer = ogg_sync_buffer(oy, VideoBuffer);
-  std::size_t bytes = fread(buffer, 1, VideoBuffer, _handle);
+  char *buffer = ogg_sync_buffer(oy, _readSize);
+  std::size_t bytes = fread(buffer, 1, _readSize, _handle);
   
   ogg_sync_wrote(oy, bytes);
   
+  _bytesRead += bytes;
+  _updateReadSize();
+  
   return(bytes);
 }
 
@@ -430,8 +723,7 @@ void Video::_convertToRGB(uint8_t* puc_y, int stride_y,
                             uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
                             uint8_t* puc_out, int width_y, int height_y,
                             unsigned int _stride_out) {
-  int x, y;
-  int stride_diff = 6 * _stride_out - 3 * width_y;
+  int y;
   
   if (height_y < 0) {
     // We are flipping our output upside-down
@@ -444,62 +736,238 @@ void Video::_convertToRGB(uint8_t* puc_y, int stride_y,
   }
   
   for (y = 0; y < height_y; y += 2) {
-    uint8_t* pY = puc_y;
-    uint8_t* pY1 = puc_y+stride_y;
-    uint8_t* pU = puc_u;
-    uint8_t* pV = puc_v;
-    uint8_t* pOut2 = puc_out + 3 * _stride_out;
-    
-    for (x = 0; x < width_y; x += 2) {
-      int R, G, B;
-      int Y;
-      unsigned int tmp;
-      
-      R = _lookUpTable.m_plRV[*pU];
-      G = _lookUpTable.m_plGV[*pU];
-      pU++;
-      G += _lookUpTable.m_plGU[*pV];
-      B = _lookUpTable.m_plBU[*pV];
-      pV++;
-      Y = _lookUpTable.m_plY[*pY];
-      pY++;
-      DGPutComponent(puc_out, R+Y, 0);
-      DGPutComponent(puc_out, G+Y, 1);
-      DGPutComponent(puc_out, B+Y, 2);
-      Y = _lookUpTable.m_plY[*pY];
-      pY++;
-      DGPutComponent(puc_out, R+Y, 3);
-      DGPutComponent(puc_out, G+Y, 4);
-      DGPutComponent(puc_out, B+Y, 5);
-      Y = _lookUpTable.m_plY[*pY1];
-      pY1++;
-      DGPutComponent(pOut2, R+Y, 0);
-      DGPutComponent(pOut2, G+Y, 1);
-      DGPutComponent(pOut2, B+Y, 2);
-      Y = _lookUpTable.m_plY[*pY1];
-      pY1++;
-      DGPutComponent(pOut2, R+Y, 3);
-      DGPutComponent(pOut2, G+Y, 4);
-      DGPutComponent(pOut2, B+Y, 5);
-      puc_out += 6;
-      pOut2 += 6;
-    }
+    _convertRowsFunction(puc_y, puc_y + stride_y, puc_u, puc_v,
+                         puc_out, puc_out + 3 * _stride_out, width_y);
     
     puc_y   += 2 * stride_y;
     puc_u   += stride_uv;
     puc_v   += stride_uv;
-    puc_out += stride_diff;
+    puc_out += 6 * _stride_out;
+  }
+}
+
+void Video::_convertRows(const uint8_t* pY, const uint8_t* pY1,
+                         const uint8_t* pU, const uint8_t* pV,
+                         uint8_t* pOut, uint8_t* pOut2, int width) {
+  for (int x = 0; x < width; x += 2) {
+    int R, G, B;
+    int Y;
+    unsigned int tmp;
+    
+    R = _lookUpTable.m_plRV[*pU];
+    G = _lookUpTable.m_plGV[*pU];
+    pU++;
+    G += _lookUpTable.m_plGU[*pV];
+    B = _lookUpTable.m_plBU[*pV];
+    pV++;
+    Y = _lookUpTable.m_plY[*pY];
+    pY++;
+    DGPutComponent(pOut, R+Y, 0);
+    DGPutComponent(pOut, G+Y, 1);
+    DGPutComponent(pOut, B+Y, 2);
+    Y = _lookUpTable.m_plY[*pY];
+    pY++;
+    DGPutComponent(pOut, R+Y, 3);
+    DGPutComponent(pOut, G+Y, 4);
+    DGPutComponent(pOut, B+Y, 5);
+    Y = _lookUpTable.m_plY[*pY1];
+    pY1++;
+    DGPutComponent(pOut2, R+Y, 0);
+    DGPutComponent(pOut2, G+Y, 1);
+    DGPutComponent(pOut2, B+Y, 2);
+    Y = _lookUpTable.m_plY[*pY1];
+    pY1++;
+    DGPutComponent(pOut2, R+Y, 3);
+    DGPutComponent(pOut2, G+Y, 4);
+    DGPutComponent(pOut2, B+Y, 5);
+    pOut += 6;
+    pOut2 += 6;
+  }
+}
+
+#ifdef DAGON_SSE2
+
+// Sums of products are exact in 32 bits, and shifting then saturating to
+// bytes clamps exactly like DGPutComponent, so the output is bit-identical
+static inline __m128i DGConvertComponent(__m128i first, __m128i second,
+                                         __m128i coefficients, __m128i extra) {
+  __m128i low = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(first, second), coefficients),
+                              _mm_unpacklo_epi16(extra, _mm_srai_epi16(extra, 15)));
+  __m128i high = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(first, second), coefficients),
+                               _mm_unpackhi_epi16(extra, _mm_srai_epi16(extra, 15)));
+  return _mm_packs_epi32(_mm_srai_epi32(low, DGConversionPrecision),
+                         _mm_srai_epi32(high, DGConversionPrecision));
+}
+
+static inline void DGConvertRow(__m128i luma, __m128i u, __m128i v,
+                                __m128i greenV, uint8_t* r, uint8_t* g, uint8_t* b) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i rounding = _mm_set1_epi16(DGConversionPrecision / 2);
+  const __m128i red = _mm_setr_epi16(DGCoefficientY, DGCoefficientRV,
+                                     DGCoefficientY, DGCoefficientRV,
+                                     DGCoefficientY, DGCoefficientRV,
+                                     DGCoefficientY, DGCoefficientRV);
+  const __m128i green = _mm_setr_epi16(DGCoefficientY, -DGCoefficientGV,
+                                       DGCoefficientY, -DGCoefficientGV,
+                                       DGCoefficientY, -DGCoefficientGV,
+                                       DGCoefficientY, -DGCoefficientGV);
+  const __m128i blue = _mm_setr_epi16(DGCoefficientY, DGCoefficientBU,
+                                      DGCoefficientY, DGCoefficientBU,
+                                      DGCoefficientY, DGCoefficientBU,
+                                      DGCoefficientY, DGCoefficientBU);
+  const __m128i offset = _mm_set1_epi16(16);
+  
+  // 16 pixels, each chroma sample covering two of them
+  __m128i lumaLow = _mm_sub_epi16(_mm_unpacklo_epi8(luma, zero), offset);
+  __m128i lumaHigh = _mm_sub_epi16(_mm_unpackhi_epi8(luma, zero), offset);
+  __m128i uLow = _mm_unpacklo_epi16(u, u);
+  __m128i uHigh = _mm_unpackhi_epi16(u, u);
+  __m128i vLow = _mm_unpacklo_epi16(v, v);
+  __m128i vHigh = _mm_unpackhi_epi16(v, v);
+  __m128i greenLow = _mm_add_epi16(_mm_unpacklo_epi16(greenV, greenV), rounding);
+  __m128i greenHigh = _mm_add_epi16(_mm_unpackhi_epi16(greenV, greenV), rounding);
+  
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(r),
+                   _mm_packus_epi16(DGConvertComponent(lumaLow, uLow, red, rounding),
+                                    DGConvertComponent(lumaHigh, uHigh, red, rounding)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(g),
+                   _mm_packus_epi16(DGConvertComponent(lumaLow, uLow, green, greenLow),
+                                    DGConvertComponent(lumaHigh, uHigh, green, greenHigh)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(b),
+                   _mm_packus_epi16(DGConvertComponent(lumaLow, vLow, blue, rounding),
+                                    DGConvertComponent(lumaHigh, vHigh, blue, rounding)));
+}
+
+#endif
+
+void Video::_convertRowsSSE2(const uint8_t* pY, const uint8_t* pY1,
+                             const uint8_t* pU, const uint8_t* pV,
+                             uint8_t* pOut, uint8_t* pOut2, int width) {
+  int x = 0;
+#ifdef DAGON_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i center = _mm_set1_epi16(128);
+  const __m128i coefficientGU = _mm_set1_epi16(-DGCoefficientGU);
+  uint8_t r[16], g[16], b[16];
+  
+  for (; (x + 16) <= width; x += 16) {
+    __m128i u = _mm_sub_epi16(_mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pU + (x >> 1))), zero), center);
+    __m128i v = _mm_sub_epi16(_mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pV + (x >> 1))), zero), center);
+    
+    // The blue difference term of green fits in 16 bits on its own
+    __m128i greenV = _mm_mullo_epi16(v, coefficientGU);
+    
+    const uint8_t* rows[2] = {pY + x, pY1 + x};
+    uint8_t* outputs[2] = {pOut + (x * 3), pOut2 + (x * 3)};
+    for (int row = 0; row < 2; row++) {
+      DGConvertRow(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[row])),
+                   u, v, greenV, r, g, b);
+      uint8_t* out = outputs[row];
+      for (int i = 0; i < 16; i++) {
+        out[0] = r[i];
+        out[1] = g[i];
+        out[2] = b[i];
+        out += 3;
+      }
+    }
+  }
+#endif
+  _convertRows(pY + x, pY1 + x, pU + (x >> 1), pV + (x >> 1),
+               pOut + (x * 3), pOut2 + (x * 3), width - x);
+}
+
+// Runs the selected kernel over every combination of Y, U and V, comparing
+// it with the scalar one built on the lookup table
+bool Video::_verifyConversion() {
+  if (_convertRowsFunction == _convertRows)
+    return true;
+  
+  const int width = 512;
+  std::vector<uint8_t> lumaTop(width), lumaBottom(width);
+  std::vector<uint8_t> u(width / 2), v(width / 2);
+  std::vector<uint8_t> expected(width * 6), output(width * 6);
+  for (int i = 0; i < (width / 2); i++)
+    u[i] = static_cast<uint8_t>(i);
+  
+  for (int chroma = 0; chroma < 256; chroma++) {
+    std::fill(v.begin(), v.end(), static_cast<uint8_t>(chroma));
+    for (int luma = 0; luma < 256; luma += 2) {
+      std::fill(lumaTop.begin(), lumaTop.end(), static_cast<uint8_t>(luma));
+      std::fill(lumaBottom.begin(), lumaBottom.end(), static_cast<uint8_t>(luma + 1));
+      _convertRows(&lumaTop[0], &lumaBottom[0], &u[0], &v[0],
+                   &expected[0], &expected[width * 3], width);
+      _convertRowsFunction(&lumaTop[0], &lumaBottom[0], &u[0], &v[0],
+                           &output[0], &output[width * 3], width);
+      if (memcmp(&expected[0], &output[0], expected.size()) != 0)
+        return false;
+    }
   }
+  return true;
 }
   
+void Video::_flushFrames() {
+  SDL_AtomicLock(&_queueLock);
+  _writeIndex = (_readIndex + 1) % VideoFrameSlots;
+  _numOfQueued = 0;
+  SDL_AtomicUnlock(&_queueLock);
+}
+
+// Runs on the video thread, so the master audio is only read through its
+// published cursor
+void Video::_followMaster() {
+  if (!_masterAudio || !_masterAudio->isAudible())
+    return;
+  
+  double cursor = _masterAudio->cursor();
+  double length = _masterAudio->length();
+  SDL_AtomicLock(&_queueLock);
+  double drift = _clock() - cursor;
+  if (length > 0.0) {
+    // Either of them may have looped, so take the shortest way round
+    drift = std::fmod(drift, length);
+    if (drift > (length / 2.0))
+      drift -= length;
+    else if (drift < -(length / 2.0))
+      drift += length;
+  }
+  if (std::fabs(drift) > (_frameDuration / 2000.0))
+    _clockBase += drift;
+  SDL_AtomicUnlock(&_queueLock);
+}
+
+double Video::_frameTime() {
+  double step = _frameDuration / 1000.0;
+  double time = _theoraInfo->videobuf_time;
+  
+  // The first frame starts the clock. Loops and frames without a granule
+  // position would take us back in time, so those follow the last frame.
+  if (!_hasTimeBase) {
+    _timeOffset = -time;
+    _hasTimeBase = true;
+  } else if ((time + _timeOffset) <= _lastFrameTime) {
+    _timeOffset = (_lastFrameTime + step) - time;
+  }
+  _lastFrameTime = time + _timeOffset;
+  return _lastFrameTime;
+}
+
+void Video::_applyQuality() {
+  int maximum = 0;
+  th_decode_ctl(_theoraInfo->td, TH_DECCTL_GET_PPLEVEL_MAX, &maximum, sizeof(maximum));
+  int level = std::max(0, std::min(_quality, maximum));
+  th_decode_ctl(_theoraInfo->td, TH_DECCTL_SET_PPLEVEL, &level, sizeof(level));
+}
+
 void Video::_initConversionToRGB() {
   // Manually tweaked alues from http://www.fourcc.org/fccyvrgb.php
-  static const int prec = 8;
-  static const int CoY	= (int)(1.169 * (1 << prec) + 0.5);
-  static const int CoRV	= (int)(2.042 * (1 << prec) + 0.5);
-  static const int CoGU	= (int)(0.841 * (1 << prec) + 0.5);
-  static const int CoGV	= (int)(0.393 * (1 << prec) + 0.5);
-  static const int CoBU	= (int)(1.628 * (1 << prec) + 0.5);
+  static const int prec = DGConversionPrecision;
+  static const int CoY	= DGCoefficientY;
+  static const int CoRV	= DGCoefficientRV;
+  static const int CoGU	= DGCoefficientGU;
+  static const int CoGV	= DGCoefficientGV;
+  static const int CoBU	= DGCoefficientBU;
   
   for (int i = 0; i < 256; ++i) {
 		_lookUpTable.m_plGU[i] = -CoGU * (i - 128);
@@ -508,36 +976,108 @@ void Video::_initConversionToRGB() {
 		_lookUpTable.m_plRV[i] = CoRV * (i - 128);
 		_lookUpTable.m_plY[i]  = CoY * (i - 16) + (prec / 2);
 	}
+  
+  if (_convertRowsFunction)
+    return;
+  
+  _convertRowsFunction = _convertRows;
+#ifdef DAGON_SSE2
+  // Every CPU this is built for has SSE2
+  _convertRowsFunction = _convertRowsSSE2;
+#endif
+#ifdef DAGON_AVX2
+  if (DGHasAVX2())
+    _convertRowsFunction = _convertRowsAVX2;
+#endif
+  
+#if defined(DEBUG) || defined(_DEBUG)
+  if (!_verifyConversion()) {
+    log.error(kModVideo, "%s", kString17012);
+    _convertRowsFunction = _convertRows;
+  }
+#endif
+}
+
+void Video::_outputFrame(double time) {
+  DGFrame* frame = &_frames[_writeIndex];
+  
+  // Duplicate frames and the ones we guessed were late come with no stripes
+  if (!_hasStripes) {
+    th_ycbcr_buffer buffer;
+    th_decode_ycbcr_out(_theoraInfo->td, buffer);
+    _outputRows(buffer, 0, frame->height);
+  }
+  frame->time = time;
+  
+  SDL_AtomicLock(&_queueLock);
+  _writeIndex = (_writeIndex + 1) % VideoFrameSlots;
+  _numOfQueued++;
+  SDL_AtomicUnlock(&_queueLock);
+}
+
+void Video::_outputRows(th_img_plane* buffer, int first, int last) {
+  DGFrame* frame = &_frames[_writeIndex];
+  int width = frame->width;
+  int height = frame->height;
+  
+  if (frame->depth == 12) {
+    // Just pack the planes, the shader does the rest
+    unsigned char* luma = frame->data;
+    unsigned char* chroma[2];
+    chroma[0] = luma + (width * height);
+    chroma[1] = chroma[0] + ((width >> 1) * (height >> 1));
+    for (int y = first; y < last; y++)
+      memcpy(luma + (y * width), buffer[0].data + (y * buffer[0].stride), width);
+    for (int i = 0; i < 2; i++) {
+      th_img_plane* plane = &buffer[i + 1];
+      for (int y = (first >> 1); y < (last >> 1); y++)
+        memcpy(chroma[i] + (y * (width >> 1)), plane->data + (y * plane->stride), width >> 1);
+    }
+  } else {
+    _convertToRGB(buffer[0].data + (first * buffer[0].stride), buffer[0].stride,
+                  buffer[1].data + ((first >> 1) * buffer[1].stride),
+                  buffer[2].data + ((first >> 1) * buffer[2].stride), buffer[1].stride,
+                  frame->data + (first * width * 3), width, last - first, width);
+  }
+}
+
+void Video::_outputStripe(void* ctx, th_ycbcr_buffer buffer, int firstFragment, int lastFragment) {
+  Video* video = static_cast<Video*>(ctx);
+  if (video->_isConvertingStripes) {
+    // Fragments are 8 pixels high
+    int last = std::min(lastFragment * 8, video->_frames[video->_writeIndex].height);
+    video->_outputRows(buffer, firstFragment * 8, last);
+    video->_hasStripes = true;
+  }
 }
 
 int Video::_prepareFrame() {
+  bool hasLooped = false;
   while (_state == VideoPlaying) {
     while (_theoraInfo->theora_p && !_theoraInfo->videobuf_ready) {
       if (ogg_stream_packetout(&_theoraInfo->to, &_theoraInfo->op) > 0) {
-        theora_decode_packetin(&_theoraInfo->td, &_theoraInfo->op);
-        _theoraInfo->videobuf_granulepos = _theoraInfo->td.granulepos;
-        _theoraInfo->videobuf_time = theora_granule_time(&_theoraInfo->td, _theoraInfo->videobuf_granulepos);
-        _theoraInfo->videobuf_ready = 1;
-        
-        if (!_theoraInfo->bos) {
-          _theoraInfo->bos = _theoraInfo->td.granulepos;
+        // Stripes are handed to us from within here
+        if (th_decode_packetin(_theoraInfo->td, &_theoraInfo->op,
+                               &_theoraInfo->videobuf_granulepos) >= 0) {
+          _theoraInfo->videobuf_time = th_granule_time(_theoraInfo->td, _theoraInfo->videobuf_granulepos);
+          _theoraInfo->videobuf_ready = 1;
+          _framesDecoded++;
         }
       } else
         break;
     }
     
     if (!_theoraInfo->videobuf_ready && feof(_handle)) {
-      if (_isLoopable) {
-        // This is the begin of stream (granule position) * 8 bits (in bytes)
-        fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
-        ogg_stream_reset(&_theoraInfo->to);
+      if (_isLoopable && !hasLooped) {
+        // Carry on straight from the first frame
+        _rewind();
+        hasLooped = true;
+        continue;
       }
-      else {
-        _state = VideoStopped;
-        
-        // Rewind
-        fseek(_handle, (long)_theoraInfo->bos * 8, SEEK_SET);
-        ogg_stream_reset(&_theoraInfo->to);
+      else if (!_isLoopable) {
+        // Let the queued frames play out before stopping
+        _isDraining = true;
+        _endTime = _lastFrameTime + (_frameDuration / 1000.0);
       }
       
       break;
@@ -560,6 +1100,99 @@ int Video::_prepareFrame() {
   return 0;
 }
 
+void Video::_rewind() {
+  // Jump right to the first data page and drop whatever was buffered
+  fseek(_handle, _dataOffset, SEEK_SET);
+  ogg_sync_reset(&_theoraInfo->oy);
+  ogg_stream_reset(&_theoraInfo->to);
+}
+
+void Video::_updateReadSize() {
+  // Use the nominal bitrate if there's one, otherwise what we've seen so far
+  double bytesPerSecond = _theoraInfo->ti.target_bitrate / 8.0;
+  if ((bytesPerSecond <= 0.0) && (_framesDecoded > 0) && (_frameDuration > 0.0))
+    bytesPerSecond = _bytesRead / ((_framesDecoded * _frameDuration) / 1000.0);
+  
+  double size = (bytesPerSecond * config.videoReadAhead) / 1000.0;
+  if (size < VideoBuffer)
+    _readSize = VideoBuffer;
+  else if (size > VideoMaxReadSize)
+    _readSize = VideoMaxReadSize;
+  else
+    _readSize = static_cast<std::size_t>(size);
+}
+
+void Video::_start() {
+  _flushFrames();
+  SDL_AtomicLock(&_queueLock);
+  _clockBase = static_cast<double>(SDL_GetPerformanceCounter()) / SDL_GetPerformanceFrequency();
+  _state = VideoPlaying;
+  SDL_AtomicUnlock(&_queueLock);
+  _hasTimeBase = false;
+  _isDraining = false;
+  
+  // Have the first frame ready right away
+  _isConvertingStripes = true;
+  _hasStripes = false;
+  if (_prepareFrame())
+    _outputFrame(_frameTime());
+}
+
+long Video::_scanForData() {
+  ogg_sync_state sync;
+  ogg_stream_state stream;
+  ogg_page page;
+  ogg_packet packet;
+  bool hasStream = false;
+  int headers = 0;
+  long offset = 0;
+  long value = 0;
+  
+  ogg_sync_init(&sync);
+  fseek(_handle, 0, SEEK_SET);
+  while (true) {
+    long bytes = ogg_sync_pageseek(&sync, &page);
+    if (bytes < 0) {
+      // Skipped some garbage
+      offset -= bytes;
+      continue;
+    }
+    
+    if (bytes == 0) {
+      if (_bufferData(&sync) == 0)
+        break;
+      continue;
+    }
+    
+    if (ogg_page_serialno(&page) == _theoraInfo->to.serialno) {
+      if (headers == 3) {
+        value = offset;
+        break;
+      }
+      
+      if (!hasStream) {
+        ogg_stream_init(&stream, ogg_page_serialno(&page));
+        hasStream = true;
+      }
+      ogg_stream_pagein(&stream, &page);
+      while ((headers < 3) && (ogg_stream_packetout(&stream, &packet) > 0))
+        headers++;
+      
+      // Data sharing a page with the headers, so start from here
+      if ((headers == 3) && (ogg_stream_packetpeek(&stream, NULL) > 0)) {
+        value = offset;
+        break;
+      }
+    }
+    offset += bytes;
+  }
+  
+  if (hasStream)
+    ogg_stream_clear(&stream);
+  ogg_sync_clear(&sync);
+  return value;
+}
+
 int Video::_queuePage(DGTheoraInfo* theoraInfo, ogg_page *page) {
   if (theoraInfo->theora_p) ogg_stream_pagein(&theoraInfo->to, page);
   
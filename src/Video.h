@@ -18,8 +18,9 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
-#include <theora/theora.h>
+#include <theora/theoradec.h>
 
 #include "Object.h"
 
@@ -41,18 +42,19 @@ typedef struct {
   int height;
   int depth;
   unsigned char* data;
+  double time; // When it's due, in seconds of the media clock
 } DGFrame;
 
 typedef struct {
   ogg_sync_state oy;
   ogg_page og;
   ogg_stream_state to;
-  theora_info ti;
-  theora_comment tc;
-  theora_state td;
+  th_info ti;
+  th_comment tc;
+  th_setup_info* ts;
+  th_dec_ctx* td;
   ogg_packet op;
   
-  ogg_int64_t bos;
   int long_option_index;
   int c;
   int theora_p;
@@ -61,7 +63,29 @@ typedef struct {
   double videobuf_time;
 } DGTheoraInfo;
 
+// Reads are sized to cover the configured read-ahead at the stream's
+// bitrate, within these bounds (in bytes)
 #define VideoBuffer 4096
+#define VideoMaxReadSize (1024 * 1024)
+
+// Frames are decoded ahead into a ring and shown once the media clock
+// reaches them. The renderer keeps the slot it last took, and the decoder
+// may fill all the others.
+#define VideoQueueFrames 4
+#define VideoFrameSlots (VideoQueueFrames + 1)
+
+// Frames the decoder skips in one go when it's already late for them.
+// Further behind than this, it shows one anyway and keeps catching up.
+#define VideoMaxLateFrames 4
+
+// Fixed point coefficients of the YUV to RGB conversion, shared by the
+// lookup table and the SIMD kernels
+#define DGConversionPrecision 8
+#define DGCoefficientY  ((int)(1.169 * (1 << DGConversionPrecision) + 0.5))
+#define DGCoefficientRV ((int)(2.042 * (1 << DGConversionPrecision) + 0.5))
+#define DGCoefficientGU ((int)(0.841 * (1 << DGConversionPrecision) + 0.5))
+#define DGCoefficientGV ((int)(0.393 * (1 << DGConversionPrecision) + 0.5))
+#define DGCoefficientBU ((int)(1.628 * (1 << DGConversionPrecision) + 0.5))
 
 #define DGPutComponent(p, v, i) \
 tmp = (unsigned int)(v); \
@@ -70,31 +94,61 @@ p[i] = tmp >> 8; \
 else \
 p[i] = (tmp >> 24) ^ 0xff;
 
+class Audio;
+class Config;
 class Log;
+class Texture;
 
 ////////////////////////////////////////////////////////////
 // Interface
 ////////////////////////////////////////////////////////////
 
 class Video : public Object {
+  Config& config;
   Log& log;
   
-  DGFrame _auxFrame;
-  DGFrame _currentFrame;
+  DGFrame _frames[VideoFrameSlots];
+  int _readIndex; // Slot the renderer holds
+  int _writeIndex; // Slot the decoder fills next
+  int _numOfQueued;
   DGTheoraInfo* _theoraInfo;
   
+  // Media clock, running from the first frame. It follows the master
+  // audio whenever that one is audible.
+  Audio* _masterAudio;
+  double _clockBase;
+  double _pauseTime;
+  double _timeOffset; // Keeps frame times going forward across loops
+  double _lastFrameTime;
+  double _endTime;
+  bool _hasTimeBase;
+  bool _isDraining; // Stream ended, waiting for the last frames to show
+  long _dataOffset; // First page after the headers, starting with a keyframe
+  
+  std::size_t _readSize;
+  std::size_t _bytesRead;
+  int _framesDecoded; // Together with the above, estimates the bitrate
+  
+  // Rows are converted while still in cache as the decoder hands them
+  // over, unless the frame is expected to be skipped
+  bool _isConvertingStripes;
+  bool _hasStripes;
+  int _quality;
+  
+  Texture* _texture; // Shared by every spot showing this video
+  
   bool _doesAutoplay;
+  SDL_atomic_t _droppedFrames;
   double _frameDuration;
   FILE* _handle;
-  bool _hasNewFrame;
   bool _hasResource;
   bool _isLoaded;
   bool _isLoopable;
   bool _isSynced;
-  double _lastTime;
   int _state;
   
   SDL_mutex* _mutex;
+  SDL_SpinLock _queueLock; // Guards the ring and the clock, held briefly
   
   // Eventually all file management will be handled by a DGResourceManager object
   char _resource[kMaxFileLength];
@@ -105,7 +159,32 @@ class Video : public Object {
                      uint8_t* puc_u, uint8_t* puc_v, int stride_uv,
                      uint8_t* puc_out, int width_y, int height_y,
                      unsigned int _stride_out);
+  double _clock();
+  void _flushFrames();
+  void _applyQuality();
+  void _followMaster();
+  double _frameTime(); // Presentation time of the frame just decoded
   void _initConversionToRGB();
+  void _outputFrame(double time);
+  void _outputRows(th_img_plane* buffer, int first, int last);
+  static void _outputStripe(void* ctx, th_ycbcr_buffer buffer, int firstFragment, int lastFragment);
+  void _rewind();
+  long _scanForData();
+  void _start();
+  void _updateReadSize();
+  
+  // Convert a pair of rows sharing the same chroma. The SIMD variants give
+  // the exact same output as the scalar one, which handles their leftovers.
+  static void _convertRows(const uint8_t* pY, const uint8_t* pY1,
+                           const uint8_t* pU, const uint8_t* pV,
+                           uint8_t* pOut, uint8_t* pOut2, int width);
+  static void _convertRowsSSE2(const uint8_t* pY, const uint8_t* pY1,
+                               const uint8_t* pU, const uint8_t* pV,
+                               uint8_t* pOut, uint8_t* pOut2, int width);
+  static void _convertRowsAVX2(const uint8_t* pY, const uint8_t* pY1,
+                               const uint8_t* pU, const uint8_t* pV,
+                               uint8_t* pOut, uint8_t* pOut2, int width); // In VideoAVX2.cpp
+  bool _verifyConversion(); // Checks the selected kernel against the scalar one
   int _prepareFrame();
   static int _queuePage(DGTheoraInfo* theoraInfo, ogg_page *page);
   
@@ -119,6 +198,7 @@ public:
   bool doesAutoplay();
   bool hasNewFrame();
   bool hasResource();
+  bool hasTexture();
   bool isLoaded();
   bool isLoopable();
   bool isPlaying();
@@ -126,21 +206,30 @@ public:
   
   // Gets
   
+  double clock(); // In seconds
   DGFrame* currentFrame();
+  int droppedFrames();
+  int quality();
   const char* resource();
+  Texture* texture();
+  int timeToNextFrame(); // Until it needs decoding, in milliseconds, or -1 if not playing
   
   // Sets
   
   void setAutoplay(bool autoplay);
   void setLoopable(bool loopable);
+  void setMasterAudio(Audio* audio);
+  void setQuality(int level); // Post-processing, from zero (fastest) up to what the decoder allows
   void setResource(const char* fromFileName);
   void setSynced(bool synced);
+  void setTexture(Texture* texture);
   
   // State changes
   
   void load();
   void play();
   void pause();
+  void preroll(); // Load and fill the queue, then hold on the first frame
   void stop();
   void unload();
   void update();
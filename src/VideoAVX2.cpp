@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////
+//
+// DAGON - An Adventure Game Engine
+// Copyright (c) 2011-2013 Senscape s.r.l.
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the
+// Mozilla Public License, v. 2.0. If a copy of the MPL was
+// not distributed with this file, You can obtain one at
+// http://mozilla.org/MPL/2.0/.
+//
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+#include "Platform.h"
+#include "Video.h"
+
+#ifdef DAGON_AVX2
+#include <immintrin.h>
+#endif
+
+namespace dagon {
+
+////////////////////////////////////////////////////////////
+// Definitions
+////////////////////////////////////////////////////////////
+
+#ifdef DAGON_AVX2
+
+// Kept apart from the rest of the video code so that only this file is built
+// for AVX2. Visual C++ accepts the intrinsics as is; GCC and Clang get the
+// flag here, as Premake can't set flags for a single file.
+#if defined(__GNUC__)
+#define DGTargetAVX2 __attribute__((target("avx2")))
+#else
+#define DGTargetAVX2
+#endif
+
+// Luma and chroma coefficients side by side, as multiply-adds take them
+#define DGCoefficientPair(luma, chroma) \
+static_cast<int>((static_cast<unsigned int>(chroma) << 16) | (luma))
+
+// Byte shuffles spreading 16 red, green and blue components over 48 bytes of
+// interleaved RGB, three output vectors of one component each
+static const char DGInterleaveMasks[9][16] = {
+  {0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128, 5},
+  {-128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128, -128},
+  {-128, -128, 0, -128, -128, 1, -128, -128, 2, -128, -128, 3, -128, -128, 4, -128},
+  {-128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10, -128},
+  {5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128, 10},
+  {-128, 5, -128, -128, 6, -128, -128, 7, -128, -128, 8, -128, -128, 9, -128, -128},
+  {-128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128, -128},
+  {-128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15, -128},
+  {10, -128, -128, 11, -128, -128, 12, -128, -128, 13, -128, -128, 14, -128, -128, 15}
+};
+
+// Same arithmetic as the SSE2 kernel, one 16 pixel half per 128 bit lane
+static inline DGTargetAVX2 __m256i DGConvertComponentAVX2(__m256i first, __m256i second,
+                                                          __m256i coefficients, __m256i extra) {
+  __m256i sign = _mm256_srai_epi16(extra, 15);
+  __m256i low = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(first, second),
+                                                   coefficients),
+                                 _mm256_unpacklo_epi16(extra, sign));
+  __m256i high = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(first, second),
+                                                    coefficients),
+                                  _mm256_unpackhi_epi16(extra, sign));
+  return _mm256_packs_epi32(_mm256_srai_epi32(low, DGConversionPrecision),
+                            _mm256_srai_epi32(high, DGConversionPrecision));
+}
+
+static inline DGTargetAVX2 __m256i DGLoadMask(int index) {
+  __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(DGInterleaveMasks[index]));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(mask), mask, 1);
+}
+
+// Converts and stores 32 pixels of one row
+static inline DGTargetAVX2 void DGConvertRowAVX2(__m256i luma, __m256i u, __m256i v,
+                                                 __m256i greenV, uint8_t* out) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i rounding = _mm256_set1_epi16(DGConversionPrecision / 2);
+  const __m256i red = _mm256_set1_epi32(DGCoefficientPair(DGCoefficientY, DGCoefficientRV));
+  const __m256i green = _mm256_set1_epi32(DGCoefficientPair(DGCoefficientY, -DGCoefficientGV));
+  const __m256i blue = _mm256_set1_epi32(DGCoefficientPair(DGCoefficientY, DGCoefficientBU));
+  const __m256i offset = _mm256_set1_epi16(16);
+  
+  // Unpacking works within each lane, which keeps the pixels of a lane
+  // together with the chroma widened into that same lane
+  __m256i lumaLow = _mm256_sub_epi16(_mm256_unpacklo_epi8(luma, zero), offset);
+  __m256i lumaHigh = _mm256_sub_epi16(_mm256_unpackhi_epi8(luma, zero), offset);
+  __m256i uLow = _mm256_unpacklo_epi16(u, u);
+  __m256i uHigh = _mm256_unpackhi_epi16(u, u);
+  __m256i vLow = _mm256_unpacklo_epi16(v, v);
+  __m256i vHigh = _mm256_unpackhi_epi16(v, v);
+  __m256i greenLow = _mm256_add_epi16(_mm256_unpacklo_epi16(greenV, greenV), rounding);
+  __m256i greenHigh = _mm256_add_epi16(_mm256_unpackhi_epi16(greenV, greenV), rounding);
+  
+  __m256i r = _mm256_packus_epi16(DGConvertComponentAVX2(lumaLow, uLow, red, rounding),
+                                  DGConvertComponentAVX2(lumaHigh, uHigh, red, rounding));
+  __m256i g = _mm256_packus_epi16(DGConvertComponentAVX2(lumaLow, uLow, green, greenLow),
+                                  DGConvertComponentAVX2(lumaHigh, uHigh, green, greenHigh));
+  __m256i b = _mm256_packus_epi16(DGConvertComponentAVX2(lumaLow, vLow, blue, rounding),
+                                  DGConvertComponentAVX2(lumaHigh, vHigh, blue, rounding));
+  
+  // Each lane now holds 48 bytes of RGB spread over three vectors
+  __m256i rgb[3];
+  for (int i = 0; i < 3; i++) {
+    rgb[i] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, DGLoadMask(i * 3)),
+                                             _mm256_shuffle_epi8(g, DGLoadMask(i * 3 + 1))),
+                             _mm256_shuffle_epi8(b, DGLoadMask(i * 3 + 2)));
+  }
+  
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                      _mm256_permute2x128_si256(rgb[0], rgb[1], 0x20));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32),
+                      _mm256_permute2x128_si256(rgb[2], rgb[0], 0x30));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 64),
+                      _mm256_permute2x128_si256(rgb[1], rgb[2], 0x31));
+}
+
+#endif
+
+////////////////////////////////////////////////////////////
+// Implementation - Private methods
+////////////////////////////////////////////////////////////
+
+#ifdef DAGON_AVX2
+DGTargetAVX2
+#endif
+void Video::_convertRowsAVX2(const uint8_t* pY, const uint8_t* pY1,
+                             const uint8_t* pU, const uint8_t* pV,
+                             uint8_t* pOut, uint8_t* pOut2, int width) {
+  int x = 0;
+#ifdef DAGON_AVX2
+  const __m256i center = _mm256_set1_epi16(128);
+  const __m256i coefficientGU = _mm256_set1_epi16(-DGCoefficientGU);
+  
+  for (; (x + 32) <= width; x += 32) {
+    // 16 chroma samples, the first 8 widened into the low lane and the rest
+    // into the high one, matching the luma halves
+    __m256i u = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pU + (x >> 1)))), center);
+    __m256i v = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(pV + (x >> 1)))), center);
+    __m256i greenV = _mm256_mullo_epi16(v, coefficientGU);
+    
+    DGConvertRowAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pY + x)),
+                     u, v, greenV, pOut + (x * 3));
+    DGConvertRowAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pY1 + x)),
+                     u, v, greenV, pOut2 + (x * 3));
+  }
+#endif
+  _convertRowsSSE2(pY + x, pY1 + x, pU + (x >> 1), pV + (x >> 1),
+                   pOut + (x * 3), pOut2 + (x * 3), width - x);
+}
+  
+}
@@ -15,6 +15,7 @@
 // Headers
 ////////////////////////////////////////////////////////////
 
+#include <SDL2/SDL_cpuinfo.h>
 #include <SDL2/SDL_timer.h>
 
 #include "Config.h"
@@ -33,9 +34,16 @@ log(Log::instance())
 {
   _isInitialized = false;
   _isRunning = false;
+  _numOfDecodeThreads = 0;
+  _timeout = kVideoIdleTimeout;
   _mutex = SDL_CreateMutex();
-  if (!_mutex)
+  _decodeMutex = SDL_CreateMutex();
+  if (!_mutex || !_decodeMutex)
     log.error(kModVideo, "%s", kString18001);
+  _semaphore = SDL_CreateSemaphore(0);
+  _decodeSemaphore = SDL_CreateSemaphore(0);
+  if (!_semaphore || !_decodeSemaphore)
+    log.error(kModVideo, "%s", kString18004);
 }
 
 ////////////////////////////////////////////////////////////
@@ -43,6 +51,9 @@ log(Log::instance())
 ////////////////////////////////////////////////////////////
 
 VideoManager::~VideoManager() {
+  SDL_DestroySemaphore(_decodeSemaphore);
+  SDL_DestroySemaphore(_semaphore);
+  SDL_DestroyMutex(_decodeMutex);
   SDL_DestroyMutex(_mutex);
 }
 
@@ -50,6 +61,16 @@ VideoManager::~VideoManager() {
 // Implementation
 ////////////////////////////////////////////////////////////
 
+int VideoManager::droppedFrames() {
+  int value = 0;
+  std::vector<Video*>::iterator it = _arrayOfVideos.begin();
+  while (it != _arrayOfVideos.end()) {
+    value += (*it)->droppedFrames();
+    ++it;
+  }
+  return value;
+}
+
 void VideoManager::flush() {
   bool done = false;
   if (_isInitialized) {
@@ -79,7 +100,7 @@ void VideoManager::flush() {
 
 void VideoManager::init() {
   log.trace(kModVideo, "%s", kString17001);
-  log.info(kModVideo, "%s: %s", kString17006, theora_version_string());
+  log.info(kModVideo, "%s: %s", kString17006, th_version_string());
   
   // Eventually lots of Theora initialization process will be moved here
   
@@ -90,6 +111,49 @@ void VideoManager::init() {
   if (!_thread) {
     log.error(kModVideo, "%s:%s", kString18003, SDL_GetError());
   }
+  
+  // Leave one core to the main thread
+  _numOfDecodeThreads = SDL_GetCPUCount() - 1;
+  if (_numOfDecodeThreads < 1)
+    _numOfDecodeThreads = 1;
+  else if (_numOfDecodeThreads > kMaxVideoDecodeThreads)
+    _numOfDecodeThreads = kMaxVideoDecodeThreads;
+  for (int i = 0; i < _numOfDecodeThreads; i++) {
+    _decodeThreads[i] = SDL_CreateThread(_runDecodeThread, "VideoDecoder", (void*)NULL);
+    if (!_decodeThreads[i]) {
+      log.error(kModVideo, "%s:%s", kString18003, SDL_GetError());
+    }
+  }
+}
+
+bool VideoManager::isPrerolling(Video* target) {
+  bool value = false;
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    value = std::find(_arrayOfPrerollingVideos.begin(), _arrayOfPrerollingVideos.end(),
+                      target) != _arrayOfPrerollingVideos.end();
+    SDL_UnlockMutex(_decodeMutex);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+  return value;
+}
+
+void VideoManager::prerollVideo(Video* target) {
+  if (this->isPrerolling(target))
+    return;
+  
+  _activate(target);
+  
+  // Scheduled as well, so that it isn't decoded meanwhile
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    _arrayOfPrerollingVideos.push_back(target);
+    _arrayOfPrerollJobs.push_back(target);
+    _arrayOfScheduledVideos.push_back(target);
+    SDL_UnlockMutex(_decodeMutex);
+    SDL_SemPost(_decodeSemaphore);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
 }
 
 void VideoManager::registerVideo(Video* target) {
@@ -101,38 +165,43 @@ void VideoManager::requestVideo(Video* target) {
     target->load();
   }
   
-  // If the audio is not active, then it's added to
-  // that vector
-  
-  bool isActive = false;
-  std::vector<Video*>::iterator it;
-  it = _arrayOfActiveVideos.begin();
-  
-  while (it != _arrayOfActiveVideos.end()) {
-    if ((*it) == target) {
-      isActive = true;
-      break;
-    }
-    
+  _activate(target);
+}
+
+Video* VideoManager::sharedVideo(const char* resource, bool autoplay,
+                                 bool loopable, bool synced, int quality) {
+  // Spots showing the same clip the same way share one decoder and texture
+  std::vector<Video*>::iterator it = _arrayOfVideos.begin();
+  while (it != _arrayOfVideos.end()) {
+    Video* video = *it;
+    if (video->hasResource() && (strcmp(video->resource(), resource) == 0) &&
+        (video->doesAutoplay() == autoplay) && (video->isLoopable() == loopable) &&
+        (video->isSynced() == synced) && (video->quality() == quality))
+      return video;
     ++it;
   }
   
-  if (!isActive) {
-    if (SDL_LockMutex(_mutex) == 0) {
-      _arrayOfActiveVideos.push_back(target);
-      SDL_UnlockMutex(_mutex);
-    } else {
-      log.error(kModVideo, "%s", kString18002);
-    }
-  }
+  Video* video = new Video(autoplay, loopable, synced);
+  video->setResource(resource);
+  video->setQuality(quality);
+  this->registerVideo(video);
+  return video;
 }
 
 void VideoManager::terminate() {
   _isRunning = false;
+  SDL_SemPost(_semaphore);
   
   int threadReturnValue;
   SDL_WaitThread(_thread, &threadReturnValue);
   
+  for (int i = 0; i < _numOfDecodeThreads; i++)
+    SDL_SemPost(_decodeSemaphore);
+  for (int i = 0; i < _numOfDecodeThreads; i++) {
+    if (_decodeThreads[i])
+      SDL_WaitThread(_decodeThreads[i], &threadReturnValue);
+  }
+  
   // WARNING: This code assumes videos are never created
   // directly in the script
   if (!_arrayOfVideos.empty()) {
@@ -149,13 +218,30 @@ void VideoManager::terminate() {
   }
 }
 
+// Asynchronous method
 bool VideoManager::update() {
   if (_isRunning) {
+    _timeout = kVideoIdleTimeout;
     if (!_arrayOfActiveVideos.empty()) {
       if (SDL_LockMutex(_mutex) == 0) {
+        // Hand due videos to the decoders and sleep until the next deadline
         std::vector<Video*>::iterator it = _arrayOfActiveVideos.begin();
         while (it != _arrayOfActiveVideos.end()) {
-          (*it)->update();
+          bool isScheduled = false;
+          if (SDL_LockMutex(_decodeMutex) == 0) {
+            isScheduled = std::find(_arrayOfScheduledVideos.begin(),
+                                    _arrayOfScheduledVideos.end(),
+                                    *it) != _arrayOfScheduledVideos.end();
+            SDL_UnlockMutex(_decodeMutex);
+          }
+          
+          if (!isScheduled) {
+            int wait = (*it)->timeToNextFrame();
+            if (wait == 0)
+              _schedule(*it);
+            else if ((wait > 0) && (wait < _timeout))
+              _timeout = wait;
+          }
           ++it;
         }
         SDL_UnlockMutex(_mutex);
@@ -172,9 +258,95 @@ bool VideoManager::update() {
 // Implementation - Private methods
 ////////////////////////////////////////////////////////////
 
+void VideoManager::_activate(Video* target) {
+  // If the video is not active, then it's added to
+  // that vector
+  
+  bool isActive = false;
+  std::vector<Video*>::iterator it;
+  it = _arrayOfActiveVideos.begin();
+  
+  while (it != _arrayOfActiveVideos.end()) {
+    if ((*it) == target) {
+      isActive = true;
+      break;
+    }
+    
+    ++it;
+  }
+  
+  if (!isActive) {
+    if (SDL_LockMutex(_mutex) == 0) {
+      _arrayOfActiveVideos.push_back(target);
+      SDL_UnlockMutex(_mutex);
+    } else {
+      log.error(kModVideo, "%s", kString18002);
+    }
+  }
+}
+
+void VideoManager::_schedule(Video* target) {
+  if (SDL_LockMutex(_decodeMutex) == 0) {
+    _arrayOfScheduledVideos.push_back(target);
+    _arrayOfDecodeJobs.push_back(target);
+    SDL_UnlockMutex(_decodeMutex);
+    SDL_SemPost(_decodeSemaphore);
+  } else {
+    log.error(kModVideo, "%s", kString18002);
+  }
+}
+
+int VideoManager::_runDecodeThread(void *ptr) {
+  VideoManager& videoManager = VideoManager::instance();
+  while (videoManager._isRunning) {
+    SDL_SemWaitTimeout(videoManager._decodeSemaphore, kVideoIdleTimeout);
+    
+    Video* target = NULL;
+    bool isPreroll = false;
+    if (SDL_LockMutex(videoManager._decodeMutex) == 0) {
+      if (!videoManager._arrayOfPrerollJobs.empty()) {
+        target = videoManager._arrayOfPrerollJobs.front();
+        videoManager._arrayOfPrerollJobs.erase(videoManager._arrayOfPrerollJobs.begin());
+        isPreroll = true;
+      } else if (!videoManager._arrayOfDecodeJobs.empty()) {
+        target = videoManager._arrayOfDecodeJobs.front();
+        videoManager._arrayOfDecodeJobs.erase(videoManager._arrayOfDecodeJobs.begin());
+      }
+      SDL_UnlockMutex(videoManager._decodeMutex);
+    }
+    
+    if (target) {
+      if (isPreroll)
+        target->preroll();
+      else
+        target->update();
+      
+      // Done, so the scheduler may queue this video again
+      if (SDL_LockMutex(videoManager._decodeMutex) == 0) {
+        std::vector<Video*>::iterator it = std::find(videoManager._arrayOfScheduledVideos.begin(),
+                                                     videoManager._arrayOfScheduledVideos.end(),
+                                                     target);
+        if (it != videoManager._arrayOfScheduledVideos.end())
+          videoManager._arrayOfScheduledVideos.erase(it);
+        if (isPreroll) {
+          it = std::find(videoManager._arrayOfPrerollingVideos.begin(),
+                         videoManager._arrayOfPrerollingVideos.end(), target);
+          if (it != videoManager._arrayOfPrerollingVideos.end())
+            videoManager._arrayOfPrerollingVideos.erase(it);
+        }
+        SDL_UnlockMutex(videoManager._decodeMutex);
+      }
+      SDL_SemPost(videoManager._semaphore);
+    }
+  }
+  return 0;
+}
+
 int VideoManager::_runThread(void *ptr) {
-  while (VideoManager::instance().update()) {
-    SDL_Delay(1);
+  VideoManager& videoManager = VideoManager::instance();
+  while (videoManager.update()) {
+    // Sleep until the next frame is due or a decoder finishes
+    SDL_SemWaitTimeout(videoManager._semaphore, videoManager._timeout);
   }
   return 0;
 }
@@ -30,6 +30,12 @@ namespace dagon {
 // Definitions
 ////////////////////////////////////////////////////////////
 
+// Decoder threads, on top of the one that schedules frames
+#define kMaxVideoDecodeThreads 4
+
+// Longest the scheduler sleeps when no video is playing (in milliseconds)
+#define kVideoIdleTimeout 10
+
 class Config;
 class Log;
 
@@ -43,12 +49,28 @@ class VideoManager {
   
   SDL_mutex* _mutex;
   SDL_Thread* _thread;
+  SDL_sem* _semaphore;
+  int _timeout;
   std::vector<Video*> _arrayOfVideos;
   std::vector<Video*> _arrayOfActiveVideos;
   
+  // One job per video whose frame is due. Videos stay scheduled until
+  // their job is done, so each is decoded by one thread at a time.
+  SDL_Thread* _decodeThreads[kMaxVideoDecodeThreads];
+  int _numOfDecodeThreads;
+  SDL_mutex* _decodeMutex;
+  SDL_sem* _decodeSemaphore;
+  std::vector<Video*> _arrayOfDecodeJobs;
+  std::vector<Video*> _arrayOfScheduledVideos;
+  std::vector<Video*> _arrayOfPrerollJobs;
+  std::vector<Video*> _arrayOfPrerollingVideos; // Until they're done
+  
   bool _isInitialized;
   bool _isRunning;
   
+  void _activate(Video* target);
+  void _schedule(Video* target);
+  static int _runDecodeThread(void *ptr);
   static int _runThread(void *ptr);
   
   VideoManager();
@@ -62,10 +84,15 @@ public:
     return videoManager;
   }
   
+  int droppedFrames(); // Total across every video
   void init();
+  bool isPrerolling(Video* target);
   void flush();
+  void prerollVideo(Video* target); // Load and decode ahead in the background
   void registerVideo(Video* target);
   void requestVideo(Video* target);
+  Video* sharedVideo(const char* resource, bool autoplay, bool loopable, bool synced,
+                     int quality);
   void terminate();
   bool update();
 };